@@ -16,6 +16,7 @@
 #include <dlfcn.h>
 #endif
 
+#include <algorithm>
 #include <mutex>
 
 #include "llvm/IR/DebugInfo.h"
@@ -27,9 +28,15 @@
 #include "KernelInvocation.h"
 #include "Memory.h"
 #include "Program.h"
+#include "SelfProfiler.h"
+#include "TraceWriter.h"
 #include "WorkGroup.h"
 #include "WorkItem.h"
+#include "WorkerPool.h"
 
+#include "plugins/BankConflicts.h"
+#include "plugins/CacheSimulator.h"
+#include "plugins/DivergenceProfiler.h"
 #include "plugins/InstructionCounter.h"
 #include "plugins/InteractiveDebugger.h"
 #include "plugins/Logger.h"
@@ -47,12 +54,18 @@ Context::Context()
   m_globalMemory =
     new Memory(AddrSpaceGlobal, sizeof(size_t) == 8 ? 16 : 8, this);
   m_kernelInvocation = NULL;
+  m_workerPool = new WorkerPool;
+
+  if (checkEnv("OCLGRIND_SELF_PROFILE"))
+    SelfProfiler::setEnabled(true);
+  TraceWriter::init();
 
   loadPlugins();
 }
 
 Context::~Context()
 {
+  delete m_workerPool;
   delete m_llvmContext;
   delete m_globalMemory;
 
@@ -79,15 +92,30 @@ llvm::LLVMContext* Context::getLLVMContext() const
   return m_llvmContext;
 }
 
+WorkerPool* Context::getWorkerPool() const
+{
+  return m_workerPool;
+}
+
 void Context::loadPlugins()
 {
   // Create core plugins
   m_plugins.push_back(make_pair(new Logger(this), true));
   m_plugins.push_back(make_pair(new MemCheck(this), true));
 
-  if (checkEnv("OCLGRIND_INST_COUNTS"))
+  if (checkEnv("OCLGRIND_INST_COUNTS") || getenv("OCLGRIND_PROFILE") ||
+      getenv("OCLGRIND_STATS"))
     m_plugins.push_back(make_pair(new InstructionCounter(this), true));
 
+  if (checkEnv("OCLGRIND_BANK_CONFLICTS"))
+    m_plugins.push_back(make_pair(new BankConflicts(this), true));
+
+  if (checkEnv("OCLGRIND_CACHE_SIM"))
+    m_plugins.push_back(make_pair(new CacheSimulator(this), true));
+
+  if (checkEnv("OCLGRIND_DIVERGENCE"))
+    m_plugins.push_back(make_pair(new DivergenceProfiler(this), true));
+
   if (checkEnv("OCLGRIND_DATA_RACES"))
     m_plugins.push_back(make_pair(new RaceDetector(this), true));
 
@@ -142,6 +170,8 @@ void Context::loadPlugins()
       m_pluginLibraries.push_back(library);
     }
   }
+
+  updateSubscriptions();
 }
 
 void Context::unloadPlugins()
@@ -182,11 +212,44 @@ void Context::unloadPlugins()
 void Context::registerPlugin(Plugin* plugin)
 {
   m_plugins.push_back(make_pair(plugin, false));
+  updateSubscriptions();
 }
 
 void Context::unregisterPlugin(Plugin* plugin)
 {
   m_plugins.remove(make_pair(plugin, false));
+  updateSubscriptions();
+}
+
+void Context::updateSubscriptions()
+{
+  for (unsigned event = 0; event < Plugin::NUM_EVENTS; event++)
+  {
+    m_subscribers[event].clear();
+  }
+
+  m_instructionObservers.assign(llvm::Instruction::OtherOpsEnd, {});
+  for (const PluginEntry& p : m_plugins)
+  {
+    Plugin::Subscription subscription = p.first->getSubscribedEvents();
+    for (unsigned event = 0; event < Plugin::NUM_EVENTS; event++)
+    {
+      if (subscription.events & (1 << event))
+        m_subscribers[event].push_back(p.first);
+    }
+
+    // Instructions are only reported to the plugins that observe them
+    if (!(subscription.events & (1 << Plugin::INSTRUCTION_EXECUTED)))
+      continue;
+    for (unsigned opcode = 0; opcode < llvm::Instruction::OtherOpsEnd;
+         opcode++)
+    {
+      if (subscription.opcodes.empty() ||
+          count(subscription.opcodes.begin(), subscription.opcodes.end(),
+                opcode))
+        m_instructionObservers[opcode].push_back(p.first);
+    }
+  }
 }
 
 void Context::logError(const char* error) const
@@ -199,21 +262,32 @@ void Context::logError(const char* error) const
   msg.send();
 }
 
-#define NOTIFY(function, ...)                                                  \
+#define NOTIFY_PLUGINS(plugins, function, ...)                                 \
   {                                                                            \
-    PluginList::const_iterator pluginItr;                                      \
-    for (pluginItr = m_plugins.begin(); pluginItr != m_plugins.end();          \
-         pluginItr++)                                                          \
+    for (Plugin* plugin : plugins)                                             \
     {                                                                          \
-      pluginItr->first->function(__VA_ARGS__);                                 \
+      if (SelfProfiler::isEnabled())                                           \
+      {                                                                        \
+        uint64_t start = SelfProfiler::now();                                  \
+        plugin->function(__VA_ARGS__);                                         \
+        SelfProfiler::recordPlugin(plugin, SelfProfiler::now() - start);       \
+      }                                                                        \
+      else                                                                     \
+      {                                                                        \
+        plugin->function(__VA_ARGS__);                                         \
+      }                                                                        \
     }                                                                          \
   }
 
+#define NOTIFY(event, function, ...)                                           \
+  NOTIFY_PLUGINS(m_subscribers[Plugin::event], function, __VA_ARGS__)
+
 void Context::notifyInstructionExecuted(const WorkItem* workItem,
                                         const llvm::Instruction* instruction,
                                         const TypedValue& result) const
 {
-  NOTIFY(instructionExecuted, workItem, instruction, result);
+  NOTIFY_PLUGINS(m_instructionObservers[instruction->getOpcode()],
+                 instructionExecuted, workItem, instruction, result);
 }
 
 void Context::notifyKernelBegin(const KernelInvocation* kernelInvocation) const
@@ -221,12 +295,12 @@ void Context::notifyKernelBegin(const KernelInvocation* kernelInvocation) const
   assert(m_kernelInvocation == NULL);
   m_kernelInvocation = kernelInvocation;
 
-  NOTIFY(kernelBegin, kernelInvocation);
+  NOTIFY(KERNEL_BEGIN, kernelBegin, kernelInvocation);
 }
 
 void Context::notifyKernelEnd(const KernelInvocation* kernelInvocation) const
 {
-  NOTIFY(kernelEnd, kernelInvocation);
+  NOTIFY(KERNEL_END, kernelEnd, kernelInvocation);
 
   assert(m_kernelInvocation == kernelInvocation);
   m_kernelInvocation = NULL;
@@ -236,33 +310,40 @@ void Context::notifyMemoryAllocated(const Memory* memory, size_t address,
                                     size_t size, cl_mem_flags flags,
                                     const uint8_t* initData) const
 {
-  NOTIFY(memoryAllocated, memory, address, size, flags, initData);
+  NOTIFY(MEMORY_ALLOCATED, memoryAllocated, memory, address, size, flags,
+         initData);
 }
 
 void Context::notifyMemoryAtomicLoad(const Memory* memory, AtomicOp op,
                                      size_t address, size_t size) const
 {
+  if (m_subscribers[Plugin::MEMORY_ATOMIC_LOAD].empty())
+    return;
+
   if (m_kernelInvocation && m_kernelInvocation->getCurrentWorkItem())
   {
-    NOTIFY(memoryAtomicLoad, memory, m_kernelInvocation->getCurrentWorkItem(),
-           op, address, size);
+    NOTIFY(MEMORY_ATOMIC_LOAD, memoryAtomicLoad, memory,
+           m_kernelInvocation->getCurrentWorkItem(), op, address, size);
   }
 }
 
 void Context::notifyMemoryAtomicStore(const Memory* memory, AtomicOp op,
                                       size_t address, size_t size) const
 {
+  if (m_subscribers[Plugin::MEMORY_ATOMIC_STORE].empty())
+    return;
+
   if (m_kernelInvocation && m_kernelInvocation->getCurrentWorkItem())
   {
-    NOTIFY(memoryAtomicStore, memory, m_kernelInvocation->getCurrentWorkItem(),
-           op, address, size);
+    NOTIFY(MEMORY_ATOMIC_STORE, memoryAtomicStore, memory,
+           m_kernelInvocation->getCurrentWorkItem(), op, address, size);
   }
 }
 
 void Context::notifyMemoryDeallocated(const Memory* memory,
                                       size_t address) const
 {
-  NOTIFY(memoryDeallocated, memory, address);
+  NOTIFY(MEMORY_DEALLOCATED, memoryDeallocated, memory, address);
 }
 
 void Context::notifyMemoryLoad(const Memory* memory, size_t address,
@@ -270,20 +351,23 @@ void Context::notifyMemoryLoad(const Memory* memory, size_t address,
 {
   if (m_kernelInvocation)
   {
+    if (m_subscribers[Plugin::MEMORY_LOAD].empty())
+      return;
+
     if (m_kernelInvocation->getCurrentWorkItem())
     {
-      NOTIFY(memoryLoad, memory, m_kernelInvocation->getCurrentWorkItem(),
-             address, size);
+      NOTIFY(MEMORY_LOAD, memoryLoad, memory,
+             m_kernelInvocation->getCurrentWorkItem(), address, size);
     }
     else if (m_kernelInvocation->getCurrentWorkGroup())
     {
-      NOTIFY(memoryLoad, memory, m_kernelInvocation->getCurrentWorkGroup(),
-             address, size);
+      NOTIFY(MEMORY_LOAD, memoryLoad, memory,
+             m_kernelInvocation->getCurrentWorkGroup(), address, size);
     }
   }
   else
   {
-    NOTIFY(hostMemoryLoad, memory, address, size);
+    NOTIFY(HOST_MEMORY_LOAD, hostMemoryLoad, memory, address, size);
   }
 }
 
@@ -291,7 +375,7 @@ void Context::notifyMemoryMap(const Memory* memory, size_t address,
                               size_t offset, size_t size,
                               cl_mem_flags flags) const
 {
-  NOTIFY(memoryMap, memory, address, offset, size, flags);
+  NOTIFY(MEMORY_MAP, memoryMap, memory, address, offset, size, flags);
 }
 
 void Context::notifyMemoryStore(const Memory* memory, size_t address,
@@ -299,61 +383,68 @@ void Context::notifyMemoryStore(const Memory* memory, size_t address,
 {
   if (m_kernelInvocation)
   {
+    if (m_subscribers[Plugin::MEMORY_STORE].empty())
+      return;
+
     if (m_kernelInvocation->getCurrentWorkItem())
     {
-      NOTIFY(memoryStore, memory, m_kernelInvocation->getCurrentWorkItem(),
-             address, size, storeData);
+      NOTIFY(MEMORY_STORE, memoryStore, memory,
+             m_kernelInvocation->getCurrentWorkItem(), address, size,
+             storeData);
     }
     else if (m_kernelInvocation->getCurrentWorkGroup())
     {
-      NOTIFY(memoryStore, memory, m_kernelInvocation->getCurrentWorkGroup(),
-             address, size, storeData);
+      NOTIFY(MEMORY_STORE, memoryStore, memory,
+             m_kernelInvocation->getCurrentWorkGroup(), address, size,
+             storeData);
     }
   }
   else
   {
-    NOTIFY(hostMemoryStore, memory, address, size, storeData);
+    NOTIFY(HOST_MEMORY_STORE, hostMemoryStore, memory, address, size,
+           storeData);
   }
 }
 
 void Context::notifyMessage(MessageType type, const char* message) const
 {
-  NOTIFY(log, type, message);
+  NOTIFY(LOG, log, type, message);
 }
 
 void Context::notifyMemoryUnmap(const Memory* memory, size_t address,
                                 const void* ptr) const
 {
-  NOTIFY(memoryUnmap, memory, address, ptr);
+  NOTIFY(MEMORY_UNMAP, memoryUnmap, memory, address, ptr);
 }
 
 void Context::notifyWorkGroupBarrier(const WorkGroup* workGroup,
                                      uint32_t flags) const
 {
-  NOTIFY(workGroupBarrier, workGroup, flags);
+  NOTIFY(WORK_GROUP_BARRIER, workGroupBarrier, workGroup, flags);
 }
 
 void Context::notifyWorkGroupBegin(const WorkGroup* workGroup) const
 {
-  NOTIFY(workGroupBegin, workGroup);
+  NOTIFY(WORK_GROUP_BEGIN, workGroupBegin, workGroup);
 }
 
 void Context::notifyWorkGroupComplete(const WorkGroup* workGroup) const
 {
-  NOTIFY(workGroupComplete, workGroup);
+  NOTIFY(WORK_GROUP_COMPLETE, workGroupComplete, workGroup);
 }
 
 void Context::notifyWorkItemBegin(const WorkItem* workItem) const
 {
-  NOTIFY(workItemBegin, workItem);
+  NOTIFY(WORK_ITEM_BEGIN, workItemBegin, workItem);
 }
 
 void Context::notifyWorkItemComplete(const WorkItem* workItem) const
 {
-  NOTIFY(workItemComplete, workItem);
+  NOTIFY(WORK_ITEM_COMPLETE, workItemComplete, workItem);
 }
 
 #undef NOTIFY
+#undef NOTIFY_PLUGINS
 
 Context::Message::Message(MessageType type, const Context* context)
 {
@@ -7,6 +7,7 @@
 // source code.
 
 #include "common.h"
+#include "Plugin.h"
 
 namespace llvm
 {
@@ -17,9 +18,9 @@ namespace oclgrind
 {
 class KernelInvocation;
 class Memory;
-class Plugin;
 class WorkGroup;
 class WorkItem;
+class WorkerPool;
 
 typedef std::pair<Plugin*, bool> PluginEntry;
 typedef std::list<PluginEntry> PluginList;
@@ -32,6 +33,11 @@ public:
 
   Memory* getGlobalMemory() const;
   llvm::LLVMContext* getLLVMContext() const;
+  WorkerPool* getWorkerPool() const;
+  bool isInstructionObserved(unsigned opcode) const
+  {
+    return !m_instructionObservers[opcode].empty();
+  }
   bool isThreadSafe() const;
   void logError(const char* error) const;
 
@@ -70,12 +76,19 @@ public:
 private:
   mutable const KernelInvocation* m_kernelInvocation;
   Memory* m_globalMemory;
+  WorkerPool* m_workerPool;
 
   PluginList m_plugins;
   std::list<void*> m_pluginLibraries;
   void loadPlugins();
   void unloadPlugins();
 
+  // Plugins subscribed to each event, and the INSTRUCTION_EXECUTED
+  // subscribers that observe instructions with each opcode
+  std::vector<Plugin*> m_subscribers[Plugin::NUM_EVENTS];
+  std::vector<std::vector<Plugin*>> m_instructionObservers;
+  void updateSubscriptions();
+
   llvm::LLVMContext* m_llvmContext;
 
 public:
@@ -8,7 +8,11 @@
 
 #include "common.h"
 
-#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <random>
 #include <sstream>
 #include <thread>
 
@@ -17,8 +21,11 @@
 #include "KernelInvocation.h"
 #include "Memory.h"
 #include "Program.h"
+#include "SelfProfiler.h"
+#include "TraceWriter.h"
 #include "WorkGroup.h"
 #include "WorkItem.h"
+#include "WorkerPool.h"
 
 using namespace oclgrind;
 using namespace std;
@@ -28,9 +35,15 @@ struct
   int id;
   WorkGroup* workGroup;
   WorkItem* workItem;
+
+  // Work-groups claimed by this worker and their average execution time
+  size_t chunkBegin;
+  size_t chunkEnd;
+  double groupTime;
 } static THREAD_LOCAL workerState;
 
-static atomic<unsigned> nextGroupIndex;
+// Target duration (in seconds) of each chunk of work-groups claimed
+#define CHUNK_TIME 0.005
 
 KernelInvocation::KernelInvocation(const Context* context, const Kernel* kernel,
                                    unsigned int workDim, Size3 globalOffset,
@@ -58,28 +71,32 @@ KernelInvocation::KernelInvocation(const Context* context, const Kernel* kernel,
   if (!m_numWorkers || !m_context->isThreadSafe())
     m_numWorkers = 1;
 
-  // Check for quick-mode environment variable
+  // Check for lock-step execution mode (not supported when interactive)
+  m_lockStep =
+    checkEnv("OCLGRIND_LOCKSTEP") && !checkEnv("OCLGRIND_INTERACTIVE");
+
+  // Check for quick-mode and sampling environment variables
+  size_t totalGroups = m_numGroups.x * m_numGroups.y * m_numGroups.z;
+  m_sampling = false;
+  m_sample.enabled = false;
   if (checkEnv("OCLGRIND_QUICK"))
   {
     // Only run first and last work-groups in quick-mode
-    Size3 firstGroup(0, 0, 0);
-    Size3 lastGroup(m_numGroups.x - 1, m_numGroups.y - 1, m_numGroups.z - 1);
-    m_workGroups.push_back(firstGroup);
-    if (lastGroup != firstGroup)
-      m_workGroups.push_back(lastGroup);
+    if (totalGroups > 0)
+      m_scheduledGroups.push_back(0);
+    if (totalGroups > 1)
+      m_scheduledGroups.push_back(totalGroups - 1);
+    m_numScheduledGroups = m_scheduledGroups.size();
+  }
+  else if (getenv("OCLGRIND_SAMPLE"))
+  {
+    m_sampling = true;
+    m_numScheduledGroups = totalGroups;
+    sampleWorkGroups(totalGroups);
   }
   else
   {
-    for (size_t k = 0; k < m_numGroups.z; k++)
-    {
-      for (size_t j = 0; j < m_numGroups.y; j++)
-      {
-        for (size_t i = 0; i < m_numGroups.x; i++)
-        {
-          m_workGroups.push_back(Size3(i, j, k));
-        }
-      }
-    }
+    m_numScheduledGroups = totalGroups;
   }
 }
 
@@ -138,6 +155,11 @@ size_t KernelInvocation::getWorkDim() const
   return m_workDim;
 }
 
+bool KernelInvocation::isLockStep() const
+{
+  return m_lockStep;
+}
+
 void KernelInvocation::run(const Context* context, Kernel* kernel,
                            unsigned int workDim, Size3 globalOffset,
                            Size3 globalSize, Size3 localSize)
@@ -156,20 +178,39 @@ void KernelInvocation::run(const Context* context, Kernel* kernel,
 
 void KernelInvocation::run()
 {
-  nextGroupIndex = 0;
-
-  // Create worker threads
-  // TODO: Run in main thread if only 1 worker
-  vector<thread> threads;
-  for (unsigned i = 0; i < m_numWorkers; i++)
+  // Nothing to do for an empty NDRange
+  if (m_numScheduledGroups == 0)
+    return;
+
+  // No point using more workers than there are work-groups
+  unsigned numWorkers = m_numWorkers;
+  if (numWorkers > m_numScheduledGroups)
+    numWorkers = m_numScheduledGroups;
+
+  // Give each worker a contiguous range of work-groups, for locality
+  m_queues = vector<WorkerQueue>(numWorkers);
+  for (unsigned i = 0; i < numWorkers; i++)
   {
-    threads.push_back(thread(&KernelInvocation::runWorker, this, i));
+    m_queues[i].begin = (m_numScheduledGroups * i) / numWorkers;
+    m_queues[i].end = (m_numScheduledGroups * (i + 1)) / numWorkers;
   }
 
-  // Wait for workers to complete
-  for (unsigned i = 0; i < m_numWorkers; i++)
+  // Run workers using the context's thread pool (this runs on the calling
+  // thread if there is only a single worker)
+  m_context->getWorkerPool()->run(numWorkers,
+                                  [this](int id) { runWorker(id); });
+
+  // Report the fraction of the NDRange that was actually simulated
+  if (m_sampling)
   {
-    threads[i].join();
+    size_t totalGroups = m_numGroups.x * m_numGroups.y * m_numGroups.z;
+    Context::Message msg(INFO, m_context);
+    msg << "Sampled " << m_numScheduledGroups << " of " << totalGroups
+        << " work-groups (" << fixed << setprecision(2)
+        << (100.0 * m_numScheduledGroups) / totalGroups << "% coverage)"
+        << endl
+        << msg.INDENT << "Kernel: " << msg.CURRENT_KERNEL << endl;
+    msg.send();
   }
 }
 
@@ -178,15 +219,394 @@ int KernelInvocation::getWorkerID() const
   return workerState.id;
 }
 
+size_t KernelInvocation::getScheduledGroup(size_t position) const
+{
+  if (m_sample.enabled)
+    return getSampledGroup(position);
+  if (m_scheduledGroups.empty())
+    return position;
+  return m_scheduledGroups[position];
+}
+
+// Sampling modes
+enum
+{
+  SAMPLE_STRIDED,
+  SAMPLE_RANDOM,
+  SAMPLE_BOUNDARY
+};
+
+// Get the box of work-groups that are at least 'depth' work-groups away from
+// the faces of the NDRange, ignoring dimensions with a single work-group
+static bool getInnerBox(Size3 numGroups, size_t depth, Size3& begin,
+                        Size3& end)
+{
+  for (unsigned d = 0; d < 3; d++)
+  {
+    if (numGroups[d] == 1)
+    {
+      begin[d] = 0;
+      end[d] = 1;
+      continue;
+    }
+    if (2 * depth >= numGroups[d])
+      return false;
+    begin[d] = depth;
+    end[d] = numGroups[d] - depth;
+  }
+  return true;
+}
+
+static size_t getBoxSize(Size3 numGroups, size_t depth)
+{
+  Size3 begin, end;
+  if (!getInnerBox(numGroups, depth, begin, end))
+    return 0;
+  return (end.x - begin.x) * (end.y - begin.y) * (end.z - begin.z);
+}
+
+// Get the linear index of the work-group at a position within the shell of
+// work-groups that are exactly 'depth' work-groups away from the faces of
+// the NDRange, without enumerating the shell
+static size_t getShellGroup(Size3 numGroups, size_t depth, size_t position)
+{
+  Size3 begin, end, innerBegin, innerEnd;
+  getInnerBox(numGroups, depth, begin, end);
+  Size3 outer(end.x - begin.x, end.y - begin.y, end.z - begin.z);
+
+  Size3 group;
+  if (!getInnerBox(numGroups, depth + 1, innerBegin, innerEnd))
+  {
+    group = Size3(position, outer);
+  }
+  else
+  {
+    Size3 inner(innerEnd.x - innerBegin.x, innerEnd.y - innerBegin.y,
+                innerEnd.z - innerBegin.z);
+    size_t slice = outer.x * outer.y;
+    size_t front = (innerBegin.z - begin.z) * slice;
+    size_t holed = slice - inner.x * inner.y;
+    if (position < front)
+    {
+      // Slices in front of the inner box
+      group = Size3(position, outer);
+    }
+    else if (position - front < inner.z * holed)
+    {
+      // Slices intersecting the inner box
+      position -= front;
+      group.z = innerBegin.z - begin.z + position / holed;
+      position %= holed;
+
+      size_t top = (innerBegin.y - begin.y) * outer.x;
+      size_t row = outer.x - inner.x;
+      if (position < top)
+      {
+        group.y = position / outer.x;
+        group.x = position % outer.x;
+      }
+      else if (position - top < inner.y * row)
+      {
+        // Rows intersecting the inner box, either side of it
+        position -= top;
+        group.y = innerBegin.y - begin.y + position / row;
+        position %= row;
+
+        size_t left = innerBegin.x - begin.x;
+        group.x = position < left ? position : inner.x + position;
+      }
+      else
+      {
+        position -= top + inner.y * row;
+        group.y = innerEnd.y - begin.y + position / outer.x;
+        group.x = position % outer.x;
+      }
+    }
+    else
+    {
+      // Slices behind the inner box
+      position -= front + inner.z * holed;
+      group = Size3(position, outer);
+      group.z += innerEnd.z - begin.z;
+    }
+  }
+
+  group.x += begin.x;
+  group.y += begin.y;
+  group.z += begin.z;
+  return group.x + (group.y + group.z * numGroups.y) * numGroups.x;
+}
+
+// Spread 'count' positions evenly across 'size' positions
+static size_t getStridedPosition(size_t position, size_t count, size_t size)
+{
+  return ((2 * position + 1) * size) / (2 * count);
+}
+
+static uint64_t mix(uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+size_t KernelInvocation::permute(size_t value, size_t size) const
+{
+  // Balanced Feistel network over the smallest even number of bits that
+  // covers the range, cycle-walking until the result is within the range
+  uint64_t mask = (1ULL << m_sample.halfBits) - 1;
+  do
+  {
+    uint64_t left = value >> m_sample.halfBits;
+    uint64_t right = value & mask;
+    for (uint64_t key : m_sample.keys)
+    {
+      uint64_t next = left ^ (mix(right ^ key) & mask);
+      left = right;
+      right = next;
+    }
+    value = (left << m_sample.halfBits) | right;
+  } while (value >= size);
+  return value;
+}
+
+size_t KernelInvocation::getSampledGroup(size_t position) const
+{
+  // Work-groups on the faces of the NDRange are scheduled first
+  if (position < m_sample.numFaceSamples)
+  {
+    if (m_sample.numFaceSamples < m_sample.numFaces)
+    {
+      position = getStridedPosition(position, m_sample.numFaceSamples,
+                                    m_sample.numFaces);
+    }
+    return getShellGroup(m_numGroups, 0, position);
+  }
+  position -= m_sample.numFaceSamples;
+
+  if (m_sample.mode == SAMPLE_BOUNDARY)
+  {
+    // Take whole shells from the faces inwards, spreading the work-groups
+    // taken from the last shell evenly across it
+    size_t shell = upper_bound(m_sample.shellEnds.begin(),
+                               m_sample.shellEnds.end(), position) -
+                   m_sample.shellEnds.begin();
+    size_t shellBegin = shell ? m_sample.shellEnds[shell - 1] : 0;
+    size_t shellSize = m_sample.shellEnds[shell] - shellBegin;
+    position -= shellBegin;
+    if (shell == m_sample.shellEnds.size() - 1)
+    {
+      size_t count = m_sample.numInteriorSamples - shellBegin;
+      if (count < shellSize)
+        position = getStridedPosition(position, count, shellSize);
+    }
+    return getShellGroup(m_numGroups, shell + 1, position);
+  }
+
+  // Select from the box of work-groups inside the faces
+  Size3 begin, end;
+  getInnerBox(m_numGroups, 1, begin, end);
+  Size3 inner(end.x - begin.x, end.y - begin.y, end.z - begin.z);
+  size_t innerSize = inner.x * inner.y * inner.z;
+  if (m_sample.mode == SAMPLE_RANDOM)
+    position = permute(position, innerSize);
+  else
+    position = getStridedPosition(position, m_sample.numInteriorSamples,
+                                  innerSize);
+
+  Size3 group(position, inner);
+  group.x += begin.x;
+  group.y += begin.y;
+  group.z += begin.z;
+  return group.x + (group.y + group.z * m_numGroups.y) * m_numGroups.x;
+}
+
+void KernelInvocation::sampleWorkGroups(size_t totalGroups)
+{
+  // Sample size is either a number of work-groups or a percentage
+  const char* sample = getenv("OCLGRIND_SAMPLE");
+  char* next;
+  double amount = strtod(sample, &next);
+  bool percentage = !strcmp(next, "%");
+  if (next == sample || (strlen(next) && !percentage) || amount <= 0 ||
+      (percentage && amount > 100) ||
+      (!percentage && amount != floor(amount)))
+  {
+    cerr << endl << "Oclgrind: Invalid value for OCLGRIND_SAMPLE" << endl;
+    abort();
+  }
+
+  size_t target;
+  if (percentage)
+    target = (size_t)ceil((totalGroups * amount) / 100);
+  else
+    target = amount < totalGroups ? (size_t)amount : totalGroups;
+  if (target >= totalGroups)
+    return;
+
+  m_sample.mode = SAMPLE_STRIDED;
+  const char* modeName = getenv("OCLGRIND_SAMPLE_MODE");
+  if (modeName && !strcmp(modeName, "random"))
+    m_sample.mode = SAMPLE_RANDOM;
+  else if (modeName && !strcmp(modeName, "boundary"))
+    m_sample.mode = SAMPLE_BOUNDARY;
+  else if (modeName && strcmp(modeName, "strided"))
+  {
+    cerr << endl
+         << "Oclgrind: Invalid value for OCLGRIND_SAMPLE_MODE" << endl;
+    abort();
+  }
+
+  m_sample.enabled = true;
+  m_numScheduledGroups = target;
+
+  // Always include the work-groups on the faces of the NDRange, since these
+  // are where boundary conditions (and partial work-groups) occur, unless
+  // there are more of them than the sample size
+  size_t numInner = getBoxSize(m_numGroups, 1);
+  m_sample.numFaces = totalGroups - numInner;
+  m_sample.numFaceSamples = min(m_sample.numFaces, target);
+  m_sample.numInteriorSamples = target - m_sample.numFaceSamples;
+
+  // Use the raw generator output (rather than a distribution) so that the
+  // selection for a given seed is identical across standard libraries
+  mt19937_64 rng(getEnvInt("OCLGRIND_SAMPLE_SEED", 0, true));
+  for (uint64_t& key : m_sample.keys)
+    key = rng();
+  unsigned bits = 1;
+  while (bits < 64 && (1ULL << bits) < numInner)
+    bits++;
+  m_sample.halfBits = (bits + 1) / 2;
+
+  // Find the shells needed to cover the sample in boundary mode
+  m_sample.shellEnds.clear();
+  if (m_sample.mode == SAMPLE_BOUNDARY)
+  {
+    size_t covered = 0;
+    for (size_t depth = 1; covered < m_sample.numInteriorSamples; depth++)
+    {
+      covered += getBoxSize(m_numGroups, depth) -
+                 getBoxSize(m_numGroups, depth + 1);
+      m_sample.shellEnds.push_back(covered);
+    }
+  }
+}
+
+bool KernelInvocation::nextWorkGroup(Size3& wgid)
+{
+  while (true)
+  {
+    if (workerState.chunkBegin == workerState.chunkEnd &&
+        !claimWorkGroups(workerState.id, workerState.groupTime,
+                         workerState.chunkBegin, workerState.chunkEnd))
+      return false;
+
+    // Skip work-groups that were already started out of order
+    size_t index = getScheduledGroup(workerState.chunkBegin++);
+    if (!m_startedGroups.empty() && m_startedGroups.count(index))
+      continue;
+
+    wgid.x = index % m_numGroups.x;
+    wgid.y = (index / m_numGroups.x) % m_numGroups.y;
+    wgid.z = index / (m_numGroups.x * m_numGroups.y);
+    return true;
+  }
+}
+
+void KernelInvocation::runWorkGroup()
+{
+  workerState.workItem = workerState.workGroup->getNextWorkItem();
+  while (workerState.workItem)
+  {
+    // Run work-item until complete or at barrier
+    while (workerState.workItem->getState() == WorkItem::READY)
+    {
+      workerState.workItem->step();
+    }
+
+    // Move to next work-item
+    workerState.workItem = workerState.workGroup->getNextWorkItem();
+    if (workerState.workItem)
+      continue;
+
+    // No more work-items in READY state
+    // Check if there are work-items at a barrier
+    if (workerState.workGroup->hasBarrier())
+    {
+      // Resume execution
+      workerState.workGroup->clearBarrier();
+      workerState.workItem = workerState.workGroup->getNextWorkItem();
+    }
+  }
+}
+
+void KernelInvocation::runWorkGroupLockStep()
+{
+  WorkGroup* workGroup = workerState.workGroup;
+  Size3 wgsize = workGroup->getGroupSize();
+  size_t numLanes = wgsize.x * wgsize.y * wgsize.z;
+
+  vector<WorkItem*> workItems;
+  while (true)
+  {
+    // Get the work-items positioned at the next instruction to execute
+    if (!workGroup->getConvergedWorkItems(workItems))
+    {
+      // No more work-items in READY state
+      // Check if there are work-items at a barrier
+      if (!workGroup->hasBarrier())
+        break;
+
+      // Resume execution
+      workGroup->clearBarrier();
+      continue;
+    }
+
+    if (workItems.size() > 1 &&
+        WorkItem::executeConverged(workItems.data(), workItems.size(),
+                                   numLanes))
+    {
+      // Instruction was executed for all work-items at once
+      for (WorkItem* workItem : workItems)
+      {
+        workerState.workItem = workItem;
+        workItem->completeConverged();
+      }
+    }
+    else
+    {
+      // Execute instruction for each work-item in turn
+      for (WorkItem* workItem : workItems)
+      {
+        workerState.workItem = workItem;
+        workItem->step();
+      }
+    }
+  }
+  workerState.workItem = NULL;
+}
+
 void KernelInvocation::runWorker(int id)
 {
   workerState.workGroup = NULL;
   workerState.workItem = NULL;
   workerState.id = id;
+  workerState.chunkBegin = 0;
+  workerState.chunkEnd = 0;
+  workerState.groupTime = 0;
+
+  bool profiling = SelfProfiler::isEnabled();
+  if (profiling)
+    SelfProfiler::beginWorker();
+
   try
   {
     while (true)
     {
+      // Stop if another worker has encountered a fatal error
+      if (m_context->getWorkerPool()->isCancelled())
+        break;
+
       // Move to next work-group
       if (!m_runningGroups.empty())
       {
@@ -197,12 +617,11 @@ void KernelInvocation::runWorker(int id)
       else
       {
         // Take next work-group from pending pool
-        unsigned index = nextGroupIndex++;
-        if (index >= m_workGroups.size())
+        Size3 wgid;
+        if (!nextWorkGroup(wgid))
           // No more work to do
           break;
 
-        Size3 wgid = m_workGroups[index];
         Size3 wgsize = m_localSize;
 
         // Handle remainder work-groups
@@ -217,30 +636,27 @@ void KernelInvocation::runWorker(int id)
       }
 
       // Execute work-group
-      workerState.workItem = workerState.workGroup->getNextWorkItem();
-      while (workerState.workItem)
-      {
-        // Run work-item until complete or at barrier
-        while (workerState.workItem->getState() == WorkItem::READY)
-        {
-          workerState.workItem->step();
-        }
-
-        // Move to next work-item
-        workerState.workItem = workerState.workGroup->getNextWorkItem();
-        if (workerState.workItem)
-          continue;
+      auto start = chrono::steady_clock::now();
+      double traceStart = TraceWriter::isEnabled() ? now() : 0;
+      if (m_lockStep)
+        runWorkGroupLockStep();
+      else
+        runWorkGroup();
 
-        // No more work-items in READY state
-        // Check if there are work-items at a barrier
-        if (workerState.workGroup->hasBarrier())
-        {
-          // Resume execution
-          workerState.workGroup->clearBarrier();
-          workerState.workItem = workerState.workGroup->getNextWorkItem();
-        }
+      if (traceStart)
+      {
+        TraceWriter::addWorkGroup(workerState.id, m_kernel->getName(),
+                                  workerState.workGroup->getGroupID(),
+                                  traceStart, now());
       }
 
+      chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+      double& groupTime = workerState.groupTime;
+      if (groupTime > 0)
+        groupTime = 0.75 * groupTime + 0.25 * elapsed.count();
+      else
+        groupTime = elapsed.count();
+
       // Work-group has finished
       m_context->notifyWorkGroupComplete(workerState.workGroup);
       delete workerState.workGroup;
@@ -255,9 +671,80 @@ void KernelInvocation::runWorker(int id)
          << err.what();
     m_context->logError(info.str().c_str());
 
+    // Cancel remaining work for all workers
+    m_context->getWorkerPool()->cancel();
+
     if (workerState.workGroup)
       delete workerState.workGroup;
   }
+
+  if (profiling)
+    SelfProfiler::endWorker(id);
+}
+
+bool KernelInvocation::claimWorkGroups(int id, double groupTime, size_t& begin,
+                                       size_t& end)
+{
+  WorkerQueue& queue = m_queues[id];
+  while (true)
+  {
+    // Claim a chunk of work-groups from the front of our own range
+    {
+      lock_guard<mutex> lock(queue.mutex);
+      size_t remaining = queue.end - queue.begin;
+      if (remaining)
+      {
+        // Size chunks to amortize the cost of claiming them, while leaving
+        // work available for other workers to steal
+        size_t chunk = 1;
+        if (m_queues.size() > 1 && groupTime > 0)
+        {
+          chunk = min<size_t>(CHUNK_TIME / groupTime, remaining / 2);
+          chunk = max<size_t>(chunk, 1);
+        }
+
+        begin = queue.begin;
+        end = begin + chunk;
+        queue.begin = end;
+        return true;
+      }
+    }
+
+    // Find the worker with the most work-groups remaining
+    WorkerQueue* victim = NULL;
+    size_t largest = 0;
+    for (WorkerQueue& other : m_queues)
+    {
+      if (&other == &queue)
+        continue;
+
+      lock_guard<mutex> lock(other.mutex);
+      if (other.end - other.begin > largest)
+      {
+        victim = &other;
+        largest = other.end - other.begin;
+      }
+    }
+    if (!victim)
+      return false;
+
+    // Steal the back half of its range
+    size_t stolenBegin, stolenEnd;
+    {
+      lock_guard<mutex> lock(victim->mutex);
+      size_t remaining = victim->end - victim->begin;
+      if (!remaining)
+        continue;
+
+      stolenEnd = victim->end;
+      stolenBegin = stolenEnd - (remaining + 1) / 2;
+      victim->end = stolenBegin;
+    }
+
+    lock_guard<mutex> lock(queue.mutex);
+    queue.begin = stolenBegin;
+    queue.end = stolenEnd;
+  }
 }
 
 bool KernelInvocation::switchWorkItem(const Size3 gid)
@@ -296,24 +783,38 @@ bool KernelInvocation::switchWorkItem(const Size3 gid)
   // Check if work-group is in pending pool
   if (!found)
   {
-    std::vector<Size3>::iterator pItr;
-    for (pItr = m_workGroups.begin() + nextGroupIndex;
-         pItr != m_workGroups.end(); pItr++)
+    // Find position of work-group in the schedule
+    size_t index =
+      group.x + (group.y + group.z * m_numGroups.y) * m_numGroups.x;
+    WorkerQueue& queue = m_queues[workerState.id];
+    size_t position = index;
+    if (m_sample.enabled)
     {
-      if (group == *pItr)
-      {
-        workerState.workGroup = new WorkGroup(this, group);
-        m_context->notifyWorkGroupBegin(workerState.workGroup);
-        found = true;
+      // Sampled work-groups are not ordered by index, so search the
+      // remaining schedule
+      position = queue.begin;
+      while (position < queue.end && getSampledGroup(position) != index)
+        position++;
+    }
+    else if (!m_scheduledGroups.empty())
+    {
+      auto itr = lower_bound(m_scheduledGroups.begin(),
+                             m_scheduledGroups.end(), index);
+      position = itr - m_scheduledGroups.begin();
+      if (itr == m_scheduledGroups.end() || *itr != index)
+        position = m_numScheduledGroups;
+    }
 
-        // Re-order list of groups accordingly
-        // Safe since this is not in a multi-threaded context
-        m_workGroups.erase(pItr);
-        m_workGroups.insert(m_workGroups.begin() + nextGroupIndex, group);
-        nextGroupIndex++;
+    if (position >= queue.begin && position < queue.end &&
+        !m_startedGroups.count(index))
+    {
+      workerState.workGroup = new WorkGroup(this, group);
+      m_context->notifyWorkGroupBegin(workerState.workGroup);
+      found = true;
 
-        break;
-      }
+      // Remember to skip this work-group when it is reached
+      // Safe since this is not in a multi-threaded context
+      m_startedGroups.insert(index);
     }
   }
 
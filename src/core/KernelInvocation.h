@@ -8,6 +8,8 @@
 
 #include "common.h"
 
+#include <mutex>
+
 namespace oclgrind
 {
 class Context;
@@ -30,6 +32,7 @@ public:
   const Kernel* getKernel() const;
   Size3 getNumGroups() const;
   size_t getWorkDim() const;
+  bool isLockStep() const;
   bool switchWorkItem(const Size3 gid);
 
   int getWorkerID() const;
@@ -50,12 +53,60 @@ private:
   Size3 m_localSize;
   Size3 m_numGroups;
 
+  // Work-groups to execute, identified by their linear index and generated
+  // on demand (optionally restricted to a sample, or a sorted list of
+  // indices in quick-mode)
+  size_t m_numScheduledGroups;
+  std::vector<size_t> m_scheduledGroups;
+  size_t getScheduledGroup(size_t position) const;
+
+  // Statistical sampling of a subset of the work-groups, which are
+  // selected on demand from their position in the schedule
+  bool m_sampling;
+  struct
+  {
+    // Whether the sample is smaller than the NDRange
+    bool enabled;
+    int mode;
+
+    // Work-groups on the faces of the NDRange, and how many are scheduled
+    size_t numFaces;
+    size_t numFaceSamples;
+
+    // Work-groups scheduled from the interior of the NDRange
+    size_t numInteriorSamples;
+
+    // Key and half-width (in bits) of the random permutation
+    uint64_t keys[4];
+    unsigned halfBits;
+
+    // Cumulative sizes of the shells of work-groups inside the faces
+    std::vector<size_t> shellEnds;
+  } m_sample;
+  size_t getSampledGroup(size_t position) const;
+  size_t permute(size_t value, size_t size) const;
+  void sampleWorkGroups(size_t totalGroups);
+
   // Current execution state
-  std::vector<Size3> m_workGroups;
   std::list<WorkGroup*> m_runningGroups;
+  std::set<size_t> m_startedGroups;
+
+  // Range of pending work-groups (positions in the schedule) for a worker
+  struct WorkerQueue
+  {
+    std::mutex mutex;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<WorkerQueue> m_queues;
+  bool claimWorkGroups(int id, double groupTime, size_t& begin, size_t& end);
+  bool nextWorkGroup(Size3& wgid);
 
   // Worker threads
   void runWorker(int id);
+  void runWorkGroup();
+  void runWorkGroupLockStep();
   unsigned m_numWorkers;
+  bool m_lockStep;
 };
 } // namespace oclgrind
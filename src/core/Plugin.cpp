@@ -14,6 +14,11 @@ Plugin::Plugin(const Context* context) : m_context(context) {}
 
 Plugin::~Plugin() {}
 
+Plugin::Subscription Plugin::getSubscribedEvents() const
+{
+  return ALL_EVENTS;
+}
+
 bool Plugin::isThreadSafe() const
 {
   return true;
@@ -21,6 +21,49 @@ class WorkItem;
 
 class Plugin
 {
+public:
+  // Simulation events, each corresponding to one of the callbacks below
+  enum Event
+  {
+    HOST_MEMORY_LOAD,
+    HOST_MEMORY_STORE,
+    INSTRUCTION_EXECUTED,
+    KERNEL_BEGIN,
+    KERNEL_END,
+    LOG,
+    MEMORY_ALLOCATED,
+    MEMORY_ATOMIC_LOAD,
+    MEMORY_ATOMIC_STORE,
+    MEMORY_DEALLOCATED,
+    MEMORY_LOAD,
+    MEMORY_MAP,
+    MEMORY_STORE,
+    MEMORY_UNMAP,
+    WORK_GROUP_BARRIER,
+    WORK_GROUP_BEGIN,
+    WORK_GROUP_COMPLETE,
+    WORK_ITEM_BEGIN,
+    WORK_ITEM_COMPLETE,
+    NUM_EVENTS
+  };
+  typedef uint32_t EventMask;
+  static const EventMask ALL_EVENTS = (1 << NUM_EVENTS) - 1;
+
+  // Events (as a mask of 1 << Event) whose callbacks a plugin implements,
+  // optionally restricting instructionExecuted to instructions with the
+  // given opcodes (every instruction is reported when none are given)
+  struct Subscription
+  {
+    Subscription(EventMask events) : events(events) {}
+    Subscription(EventMask events, std::initializer_list<unsigned> opcodes)
+        : events(events), opcodes(opcodes)
+    {
+    }
+
+    EventMask events;
+    std::vector<unsigned> opcodes;
+  };
+
 public:
   Plugin(const Context* context);
   virtual ~Plugin();
@@ -88,6 +131,11 @@ public:
 
   virtual bool isThreadSafe() const;
 
+  // Callbacks are only invoked for events that a plugin subscribes to, and
+  // instructionExecuted only for the instructions that it observes. This
+  // changes the Plugin vtable, so dynamic plugins must be rebuilt.
+  virtual Subscription getSubscribedEvents() const;
+
 protected:
   const Context* m_context;
 };
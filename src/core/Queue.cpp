@@ -9,19 +9,26 @@
 #include "common.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 
 #include "Context.h"
+#include "Kernel.h"
 #include "KernelInvocation.h"
 #include "Memory.h"
 #include "Queue.h"
+#include "TraceWriter.h"
 
 using namespace oclgrind;
 using namespace std;
 
+// Queues are numbered in order of creation, to identify them in traces
+static atomic<unsigned> numQueues(0);
+
 Queue::Queue(const Context* context, bool out_of_order)
     : m_context(context), m_out_of_order(out_of_order)
 {
+  m_id = numQueues++;
 }
 
 Queue::~Queue() {}
@@ -166,6 +173,41 @@ void Queue::executeWriteBufferRect(BufferRectCommand* cmd)
   }
 }
 
+string Queue::getCommandName(const Command* command)
+{
+  switch (command->type)
+  {
+  case Command::COPY:
+    return "Copy";
+  case Command::COPY_RECT:
+    return "Copy (rect)";
+  case Command::EMPTY:
+    return "Empty";
+  case Command::FILL_BUFFER:
+    return "Fill buffer";
+  case Command::FILL_IMAGE:
+    return "Fill image";
+  case Command::KERNEL:
+    return "Kernel " + ((const KernelCommand*)command)->kernel->getName();
+  case Command::MAP:
+    return "Map";
+  case Command::NATIVE_KERNEL:
+    return "Native kernel";
+  case Command::READ:
+    return "Read";
+  case Command::READ_RECT:
+    return "Read (rect)";
+  case Command::UNMAP:
+    return "Unmap";
+  case Command::WRITE:
+    return "Write";
+  case Command::WRITE_RECT:
+    return "Write (rect)";
+  default:
+    return "Unknown";
+  }
+}
+
 bool Queue::isEmpty() const
 {
   return m_queue.empty();
@@ -265,6 +307,13 @@ void Queue::execute(Command* command, bool flush)
   command->event->endTime = now();
   command->event->state = CL_COMPLETE;
 
+  if (TraceWriter::isEnabled() && command->type != Command::EMPTY)
+  {
+    TraceWriter::addCommand(m_id, getCommandName(command),
+                            command->event->startTime,
+                            command->event->endTime);
+  }
+
   // Remove command from its queue
   m_queue.erase(it);
 }
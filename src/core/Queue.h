@@ -224,9 +224,12 @@ public:
   bool isEmpty() const;
   Command* finish();
 
+  static std::string getCommandName(const Command* command);
+
 private:
   const Context* m_context;
   const bool m_out_of_order;
   std::list<Command*> m_queue;
+  unsigned m_id;
 };
 } // namespace oclgrind
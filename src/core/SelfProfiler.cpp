@@ -0,0 +1,275 @@
+// SelfProfiler.cpp (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#include "common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <typeinfo>
+
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+#include "llvm/IR/Instruction.h"
+
+#include "Plugin.h"
+#include "SelfProfiler.h"
+
+using namespace oclgrind;
+using namespace std;
+
+struct ProfileEntry
+{
+  string name;
+  uint64_t cycles;
+  uint64_t count;
+};
+
+typedef unordered_map<const void*, ProfileEntry> ProfileEntryMap;
+
+struct WorkerProfile
+{
+  uint64_t cycles;
+  uint64_t instructions;
+};
+
+// Timings recorded by a single host thread
+struct ThreadProfile
+{
+  vector<uint64_t> opcodeCycles;
+  vector<uint64_t> opcodeCounts;
+  ProfileEntryMap builtins;
+  ProfileEntryMap plugins;
+  map<int, WorkerProfile> workers;
+
+  uint64_t instructions;
+  uint64_t workerStart;
+  uint64_t workerInstructions;
+};
+
+atomic<bool> SelfProfiler::m_enabled(false);
+
+static mutex profilesMutex;
+static vector<ThreadProfile*> profiles;
+static bool reportRegistered = false;
+static uint64_t startCycles;
+static chrono::steady_clock::time_point startTime;
+
+static THREAD_LOCAL ThreadProfile* threadProfile = NULL;
+
+static ThreadProfile* getThreadProfile()
+{
+  // Profiles are never freed, so that they can be reported after their
+  // threads have exited
+  if (!threadProfile)
+  {
+    threadProfile = new ThreadProfile;
+    threadProfile->opcodeCycles.resize(llvm::Instruction::OtherOpsEnd);
+    threadProfile->opcodeCounts.resize(llvm::Instruction::OtherOpsEnd);
+    threadProfile->instructions = 0;
+    threadProfile->workerStart = 0;
+    threadProfile->workerInstructions = 0;
+
+    lock_guard<mutex> lock(profilesMutex);
+    profiles.push_back(threadProfile);
+  }
+  return threadProfile;
+}
+
+static string getPluginName(const Plugin* plugin)
+{
+  const char* name = typeid(*plugin).name();
+#if defined(__GNUC__)
+  int status;
+  char* demangled = abi::__cxa_demangle(name, NULL, NULL, &status);
+  if (demangled)
+  {
+    string result = demangled;
+    free(demangled);
+    return result;
+  }
+#endif
+  return name;
+}
+
+static void mergeEntries(map<string, ProfileEntry>& merged,
+                         const ProfileEntryMap& entries)
+{
+  for (auto& itr : entries)
+  {
+    ProfileEntry& entry = merged[itr.second.name];
+    entry.name = itr.second.name;
+    entry.cycles += itr.second.cycles;
+    entry.count += itr.second.count;
+  }
+}
+
+static void printEntries(const char* title, vector<ProfileEntry> entries,
+                         double cyclesPerSecond, uint64_t totalCycles)
+{
+  if (entries.empty())
+    return;
+
+  sort(entries.begin(), entries.end(),
+       [](const ProfileEntry& a, const ProfileEntry& b) {
+         return a.cycles > b.cycles;
+       });
+
+  cerr << endl
+       << title << ":" << endl
+       << setw(12) << "Time (s)" << setw(10) << "Percent" << setw(16)
+       << "Calls" << setw(12) << "ns/Call"
+       << "  Name" << endl;
+  for (const ProfileEntry& entry : entries)
+  {
+    double seconds = entry.cycles / cyclesPerSecond;
+    cerr << fixed << setprecision(3) << setw(12) << seconds
+         << setprecision(1) << setw(9)
+         << (totalCycles ? 100.0 * entry.cycles / totalCycles : 0) << "%"
+         << setw(16) << entry.count << setw(12)
+         << (entry.count ? 1e9 * seconds / entry.count : 0) << "  "
+         << entry.name << endl;
+  }
+}
+
+void SelfProfiler::beginWorker()
+{
+  ThreadProfile* profile = getThreadProfile();
+  profile->workerStart = now();
+  profile->workerInstructions = profile->instructions;
+}
+
+void SelfProfiler::endWorker(int id)
+{
+  ThreadProfile* profile = getThreadProfile();
+  WorkerProfile& worker = profile->workers[id];
+  worker.cycles += now() - profile->workerStart;
+  worker.instructions += profile->instructions - profile->workerInstructions;
+}
+
+void SelfProfiler::recordBuiltin(const void* function, const string& name,
+                                 uint64_t cycles)
+{
+  ProfileEntry& entry = getThreadProfile()->builtins[function];
+  if (!entry.count)
+    entry.name = name;
+  entry.cycles += cycles;
+  entry.count++;
+}
+
+void SelfProfiler::recordOpcode(unsigned opcode, uint64_t cycles,
+                                size_t count)
+{
+  ThreadProfile* profile = getThreadProfile();
+  profile->opcodeCycles[opcode] += cycles;
+  profile->opcodeCounts[opcode] += count;
+  profile->instructions += count;
+}
+
+void SelfProfiler::recordPlugin(const Plugin* plugin, uint64_t cycles)
+{
+  ProfileEntry& entry = getThreadProfile()->plugins[plugin];
+  if (!entry.count)
+    entry.name = getPluginName(plugin);
+  entry.cycles += cycles;
+  entry.count++;
+}
+
+void SelfProfiler::report()
+{
+  lock_guard<mutex> lock(profilesMutex);
+
+  // Calibrate the cycle counter against the time elapsed since profiling
+  // was first enabled
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+  uint64_t elapsedCycles = now() - startCycles;
+  double cyclesPerSecond = 1e9;
+  if (elapsed.count() > 0 && elapsedCycles)
+    cyclesPerSecond = elapsedCycles / elapsed.count();
+
+  // Merge the profiles of all threads
+  vector<ProfileEntry> opcodes;
+  map<string, ProfileEntry> builtins;
+  map<string, ProfileEntry> plugins;
+  map<int, WorkerProfile> workers;
+  for (unsigned opcode = 0; opcode < llvm::Instruction::OtherOpsEnd; opcode++)
+  {
+    ProfileEntry entry = {"", 0, 0};
+    for (ThreadProfile* profile : profiles)
+    {
+      entry.cycles += profile->opcodeCycles[opcode];
+      entry.count += profile->opcodeCounts[opcode];
+    }
+    if (entry.count)
+    {
+      entry.name = llvm::Instruction::getOpcodeName(opcode);
+      opcodes.push_back(entry);
+    }
+  }
+  for (ThreadProfile* profile : profiles)
+  {
+    mergeEntries(builtins, profile->builtins);
+    mergeEntries(plugins, profile->plugins);
+    for (auto& itr : profile->workers)
+    {
+      workers[itr.first].cycles += itr.second.cycles;
+      workers[itr.first].instructions += itr.second.instructions;
+    }
+  }
+
+  // Percentages are relative to the total time spent running workers
+  uint64_t totalCycles = 0;
+  for (auto& itr : workers)
+    totalCycles += itr.second.cycles;
+
+  cerr << endl << "Oclgrind self-profile:" << endl;
+  for (auto& itr : workers)
+  {
+    double seconds = itr.second.cycles / cyclesPerSecond;
+    cerr << "  Worker " << itr.first << ": " << itr.second.instructions
+         << " instructions in " << fixed << setprecision(3) << seconds
+         << " s (" << setprecision(0)
+         << (seconds > 0 ? itr.second.instructions / seconds : 0)
+         << " instructions/s)" << endl;
+  }
+
+  // Times are inclusive, so opcodes include the builtins and plugin
+  // callbacks that they invoke
+  printEntries("Host time by opcode", opcodes, cyclesPerSecond, totalCycles);
+
+  vector<ProfileEntry> entries;
+  for (auto& itr : builtins)
+    entries.push_back(itr.second);
+  printEntries("Host time by builtin", entries, cyclesPerSecond, totalCycles);
+
+  entries.clear();
+  for (auto& itr : plugins)
+    entries.push_back(itr.second);
+  printEntries("Host time by plugin", entries, cyclesPerSecond, totalCycles);
+
+  cerr << endl;
+}
+
+void SelfProfiler::setEnabled(bool enabled)
+{
+  if (enabled)
+  {
+    lock_guard<mutex> lock(profilesMutex);
+    if (!reportRegistered)
+    {
+      startCycles = now();
+      startTime = chrono::steady_clock::now();
+      atexit(report);
+      reportRegistered = true;
+    }
+  }
+
+  m_enabled.store(enabled, memory_order_relaxed);
+}
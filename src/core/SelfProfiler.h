@@ -0,0 +1,66 @@
+// SelfProfiler.h (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace oclgrind
+{
+class Plugin;
+
+// Measures the host time spent by the simulator itself, broken down by
+// opcode, builtin function, plugin and worker thread. Timings are
+// accumulated per thread and reported at exit.
+class SelfProfiler
+{
+public:
+  static bool isEnabled()
+  {
+    return m_enabled.load(std::memory_order_relaxed);
+  }
+  static void setEnabled(bool enabled);
+
+  // Read the host cycle counter (or a nanosecond clock, where unavailable)
+  static uint64_t now()
+  {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+  }
+
+  static void recordBuiltin(const void* function, const std::string& name,
+                            uint64_t cycles);
+  static void recordOpcode(unsigned opcode, uint64_t cycles,
+                           size_t count = 1);
+  static void recordPlugin(const Plugin* plugin, uint64_t cycles);
+
+  // Mark the start and end of a worker's share of a kernel invocation
+  static void beginWorker();
+  static void endWorker(int id);
+
+private:
+  static std::atomic<bool> m_enabled;
+
+  static void report();
+};
+} // namespace oclgrind
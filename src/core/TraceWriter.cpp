@@ -0,0 +1,169 @@
+// TraceWriter.cpp (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#include "common.h"
+
+#include <fstream>
+#include <mutex>
+
+#include "TraceWriter.h"
+
+using namespace oclgrind;
+using namespace std;
+
+// Processes used to group related tracks in the timeline
+#define API_PID 1
+#define QUEUE_PID 2
+#define WORKER_PID 3
+
+// Size at which a thread writes its buffered events to the file
+#define FLUSH_SIZE (1 << 20)
+
+// Events recorded by a single host thread
+struct TraceBuffer
+{
+  string events;
+  set<pair<int, size_t>> namedTracks;
+  unsigned threadIndex;
+};
+
+atomic<bool> TraceWriter::m_enabled(false);
+
+static mutex traceMutex;
+static ofstream traceStream;
+static bool traceInitialized = false;
+static double traceStart;
+static vector<TraceBuffer*> traceBuffers;
+
+static THREAD_LOCAL TraceBuffer* traceBuffer = NULL;
+
+static TraceBuffer* getTraceBuffer()
+{
+  // Buffers are never freed, so that they can be flushed after their
+  // threads have exited
+  if (!traceBuffer)
+  {
+    lock_guard<mutex> lock(traceMutex);
+    traceBuffer = new TraceBuffer;
+    traceBuffer->threadIndex = traceBuffers.size();
+    traceBuffers.push_back(traceBuffer);
+  }
+  return traceBuffer;
+}
+
+static void addEvent(int pid, size_t tid, const char* track,
+                     const string& name, double start, double end,
+                     const string& args = "")
+{
+  TraceBuffer* buffer = getTraceBuffer();
+
+  ostringstream event;
+  event << fixed << setprecision(3);
+
+  // Name each track the first time this thread uses it
+  if (buffer->namedTracks.insert(make_pair(pid, tid)).second)
+  {
+    event << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid
+          << ", \"tid\": " << tid << ", \"args\": {\"name\": \"" << track
+          << " " << tid << "\"}}";
+  }
+
+  event << ",\n{\"name\": \"" << name << "\", \"ph\": \"X\", \"pid\": " << pid
+        << ", \"tid\": " << tid << ", \"ts\": " << (start - traceStart) / 1e3
+        << ", \"dur\": " << (end - start) / 1e3;
+  if (!args.empty())
+    event << ", \"args\": {" << args << "}";
+  event << "}";
+
+  buffer->events += event.str();
+  if (buffer->events.size() >= FLUSH_SIZE)
+  {
+    lock_guard<mutex> lock(traceMutex);
+    traceStream << buffer->events;
+    buffer->events.clear();
+  }
+}
+
+void TraceWriter::addAPICall(const char* name, double start, double end)
+{
+  addEvent(API_PID, getTraceBuffer()->threadIndex, "Thread", name, start, end);
+}
+
+void TraceWriter::addCommand(unsigned queue, const string& name,
+                             double start, double end)
+{
+  addEvent(QUEUE_PID, queue, "Queue", name, start, end);
+}
+
+void TraceWriter::addWorkGroup(int worker, const string& kernel, Size3 group,
+                               double start, double end)
+{
+  ostringstream name;
+  name << "Work-group (" << group.x << "," << group.y << "," << group.z
+       << ")";
+  addEvent(WORKER_PID, worker, "Worker", name.str(), start, end,
+           "\"kernel\": \"" + kernel + "\"");
+}
+
+void TraceWriter::close()
+{
+  m_enabled.store(false, memory_order_relaxed);
+
+  lock_guard<mutex> lock(traceMutex);
+  for (TraceBuffer* buffer : traceBuffers)
+  {
+    traceStream << buffer->events;
+    buffer->events.clear();
+  }
+  traceStream << "\n]" << endl;
+  traceStream.close();
+}
+
+void TraceWriter::init()
+{
+  lock_guard<mutex> lock(traceMutex);
+  if (traceInitialized)
+    return;
+
+  const char* filename = getenv("OCLGRIND_TRACE");
+  if (!filename)
+    return;
+  traceInitialized = true;
+
+  traceStream.open(filename);
+  if (!traceStream.good())
+  {
+    cerr << "Oclgrind: Unable to open trace file '" << filename << "'"
+         << endl;
+    return;
+  }
+
+  // Events are written as a JSON array, which trace viewers accept even if
+  // the closing bracket is missing because the process was killed
+  traceStart = now();
+  traceStream << "[\n"
+              << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": "
+              << API_PID << ", \"args\": {\"name\": \"API calls\"}},\n"
+              << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": "
+              << QUEUE_PID << ", \"args\": {\"name\": \"Command queues\"}},\n"
+              << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": "
+              << WORKER_PID << ", \"args\": {\"name\": \"Workers\"}}";
+
+  atexit(close);
+  m_enabled.store(true, memory_order_relaxed);
+}
+
+// Start tracing as soon as the library is loaded, so that API calls made
+// before the first context is created are included
+static struct TraceInitializer
+{
+  TraceInitializer()
+  {
+    TraceWriter::init();
+  }
+} traceInitializer;
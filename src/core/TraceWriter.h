@@ -0,0 +1,41 @@
+// TraceWriter.h (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+
+namespace oclgrind
+{
+// Writes a timeline of API calls, commands and work-groups in the Chrome
+// trace event format, which can be viewed with chrome://tracing or
+// Perfetto. Times are as returned by now().
+class TraceWriter
+{
+public:
+  // Open the trace file named by OCLGRIND_TRACE, if not already open
+  static void init();
+  static bool isEnabled()
+  {
+    return m_enabled.load(std::memory_order_relaxed);
+  }
+
+  static void addAPICall(const char* name, double start, double end);
+  static void addCommand(unsigned queue, const std::string& name,
+                         double start, double end);
+  static void addWorkGroup(int worker, const std::string& kernel, Size3 group,
+                           double start, double end);
+
+private:
+  static std::atomic<bool> m_enabled;
+
+  static void close();
+};
+} // namespace oclgrind
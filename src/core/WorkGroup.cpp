@@ -16,6 +16,7 @@
 #include "Kernel.h"
 #include "KernelInvocation.h"
 #include "Memory.h"
+#include "Program.h"
 #include "WorkGroup.h"
 #include "WorkItem.h"
 
@@ -54,6 +55,13 @@ WorkGroup::WorkGroup(const KernelInvocation* kernelInvocation, Size3 wgid,
     }
   }
 
+  // Allocate storage for the values of every work-item
+  const InterpreterCache* cache =
+    kernel->getProgram()->getInterpreterCache(kernel->getFunction());
+  m_valueStorage =
+    new unsigned char[cache->getValueStorageSize() * m_groupSize.x *
+                      m_groupSize.y * m_groupSize.z];
+
   // Initialise work-items
   for (size_t k = 0; k < m_groupSize.z; k++)
   {
@@ -80,6 +88,7 @@ WorkGroup::~WorkGroup()
   {
     delete m_workItems[i];
   }
+  delete[] m_valueStorage;
 
   delete m_localMemory;
 }
@@ -259,6 +268,30 @@ void WorkGroup::clearBarrier()
   m_barrier = NULL;
 }
 
+bool WorkGroup::getConvergedWorkItems(vector<WorkItem*>& workItems) const
+{
+  workItems.clear();
+  if (m_running.empty())
+  {
+    return false;
+  }
+
+  // Select the running work-items positioned at the earliest instruction,
+  // which allows diverged work-items to reconverge
+  unsigned position = -1;
+  for (auto itr = m_running.begin(); itr != m_running.end(); itr++)
+  {
+    position = min(position, (*itr)->getCurrentInstructionIndex());
+  }
+  for (auto itr = m_running.begin(); itr != m_running.end(); itr++)
+  {
+    if ((*itr)->getCurrentInstructionIndex() == position)
+      workItems.push_back(*itr);
+  }
+
+  return true;
+}
+
 const llvm::Instruction* WorkGroup::getCurrentBarrier() const
 {
   return m_barrier ? m_barrier->instruction : NULL;
@@ -298,6 +331,11 @@ WorkItem* WorkGroup::getNextWorkItem() const
   return *m_running.begin();
 }
 
+unsigned char* WorkGroup::getValueStorage() const
+{
+  return m_valueStorage;
+}
+
 WorkItem* WorkGroup::getWorkItem(Size3 localID) const
 {
   return m_workItems[localID.x +
@@ -69,6 +69,7 @@ public:
                     size_t dest, size_t src, size_t size, size_t num,
                     size_t srcStride, size_t destStride, size_t event);
   void clearBarrier();
+  bool getConvergedWorkItems(std::vector<WorkItem*>& workItems) const;
   const llvm::Instruction* getCurrentBarrier() const;
   Size3 getGroupID() const;
   size_t getGroupIndex() const;
@@ -76,6 +77,7 @@ public:
   Memory* getLocalMemory() const;
   size_t getLocalMemoryAddress(const llvm::Value* value) const;
   WorkItem* getNextWorkItem() const;
+  unsigned char* getValueStorage() const;
   WorkItem* getWorkItem(Size3 localID) const;
   bool hasBarrier() const;
   void notifyBarrier(WorkItem* workItem, const llvm::Instruction* instruction,
@@ -93,6 +95,7 @@ private:
   std::map<const llvm::Value*, size_t> m_localAddresses;
 
   std::vector<WorkItem*> m_workItems;
+  unsigned char* m_valueStorage;
 
   Barrier* m_barrier;
   size_t m_nextEvent;
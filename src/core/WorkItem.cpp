@@ -28,20 +28,25 @@
 #include "KernelInvocation.h"
 #include "Memory.h"
 #include "Program.h"
+#include "SelfProfiler.h"
 #include "WorkGroup.h"
 #include "WorkItem.h"
 
 using namespace oclgrind;
 using namespace std;
 
+// Sentinel for the next instruction when no branch has been taken
+#define NO_BRANCH ((unsigned)-1)
+
 struct WorkItem::Position
 {
   bool hasBegun;
   const llvm::BasicBlock* prevBlock;
   const llvm::BasicBlock* currBlock;
-  const llvm::BasicBlock* nextBlock;
-  llvm::BasicBlock::const_iterator currInst;
+  unsigned currInst;
+  unsigned nextInst;
   std::stack<const llvm::Instruction*> callStack;
+  std::stack<unsigned> callSites;
   std::stack<std::list<size_t>> allocations;
 };
 
@@ -69,8 +74,28 @@ WorkItem::WorkItem(const KernelInvocation* kernelInvocation,
   // Load interpreter cache
   m_cache = kernel->getProgram()->getInterpreterCache(kernel->getFunction());
 
-  // Set initial number of values to store based on cache
+  // Bind values to their slots in the work-group's value storage, in which
+  // work-items are interleaved when executing in lock-step
+  Size3 wgsize = workGroup->getGroupSize();
+  size_t lane = lid.x + (lid.y + lid.z * wgsize.y) * wgsize.x;
+  size_t numLanes = wgsize.x * wgsize.y * wgsize.z;
+  unsigned char* storage = workGroup->getValueStorage();
   m_values.resize(m_cache->getNumValues());
+  for (unsigned i = 0; i < m_values.size(); i++)
+  {
+    const InterpreterCache::ValueSlot& slot = m_cache->getValueSlot(i);
+    m_values[i].size = slot.size;
+    m_values[i].num = slot.num;
+    if (kernelInvocation->isLockStep())
+    {
+      m_values[i].data = storage + slot.offset * numLanes + lane * slot.stride;
+    }
+    else
+    {
+      m_values[i].data =
+        storage + lane * m_cache->getValueStorageSize() + slot.offset;
+    }
+  }
 
   m_privateMemory =
     new Memory(AddrSpacePrivate, sizeof(size_t) == 8 ? 32 : 16, m_context);
@@ -79,9 +104,7 @@ WorkItem::WorkItem(const KernelInvocation* kernelInvocation,
   for (auto value = kernel->values_begin(); value != kernel->values_end();
        value++)
   {
-    pair<unsigned, unsigned> size = getValueSize(value->first);
-    TypedValue v = {size.first, size.second,
-                    m_pool.alloc(size.first * size.second)};
+    TypedValue v = getValue(value->first);
 
     const llvm::Type* type = value->first->getType();
     if (type->isPointerTy() &&
@@ -99,8 +122,6 @@ WorkItem::WorkItem(const KernelInvocation* kernelInvocation,
     {
       memcpy(v.data, value->second.data, v.size * v.num);
     }
-
-    setValue(value->first, v);
   }
 
   // Initialize interpreter state
@@ -108,9 +129,10 @@ WorkItem::WorkItem(const KernelInvocation* kernelInvocation,
   m_position = new Position;
   m_position->hasBegun = false;
   m_position->prevBlock = NULL;
-  m_position->nextBlock = NULL;
-  m_position->currBlock = &*kernel->getFunction()->begin();
-  m_position->currInst = m_position->currBlock->begin();
+  m_position->nextInst = NO_BRANCH;
+  m_decoded = NULL;
+  m_position->currInst = m_cache->getEntryPoint(kernel->getFunction());
+  m_position->currBlock = m_cache->getInstruction(m_position->currInst).block;
 }
 
 WorkItem::~WorkItem()
@@ -130,7 +152,13 @@ void WorkItem::clearBarrier()
 void WorkItem::dispatch(const llvm::Instruction* instruction,
                         TypedValue& result)
 {
-  switch (instruction->getOpcode())
+  dispatch(instruction->getOpcode(), instruction, result);
+}
+
+void WorkItem::dispatch(unsigned opcode, const llvm::Instruction* instruction,
+                        TypedValue& result)
+{
+  switch (opcode)
   {
   case llvm::Instruction::Add:
     add(instruction, result);
@@ -289,45 +317,83 @@ void WorkItem::dispatch(const llvm::Instruction* instruction,
   }
 }
 
-void WorkItem::execute(const llvm::Instruction* instruction)
+void WorkItem::execute(const InterpreterCache::DecodedInstruction& decoded)
 {
-  // Prepare private variable for instruction result
-  pair<unsigned, unsigned> resultSize = getValueSize(instruction);
+  const llvm::Instruction* instruction = decoded.instruction;
 
   // Prepare result
-  TypedValue result = {resultSize.first, resultSize.second, NULL};
-  if (result.size)
+  TypedValue result = {decoded.resultSize, decoded.resultNum, NULL};
+  if (decoded.opcode != llvm::Instruction::PHI)
   {
-    result.data = m_pool.alloc(result.size * result.num);
-  }
+    flushTemporaries();
 
-  if (instruction->getOpcode() != llvm::Instruction::PHI &&
-      m_phiTemps.size() > 0)
-  {
-    TypedValueMap::iterator itr;
-    for (itr = m_phiTemps.begin(); itr != m_phiTemps.end(); itr++)
+    // Write result directly to its slot
+    if (result.size)
     {
-      setValue(itr->first, itr->second);
+      result.data = m_values[decoded.valueID].data;
     }
-    m_phiTemps.clear();
   }
+  else if (result.size)
+  {
+    // PHI results are deferred until all PHI nodes have been evaluated
+    result.data = m_pool.alloc(result.size * result.num);
+  }
+
+  bool profiling = SelfProfiler::isEnabled();
+  uint64_t start = profiling ? SelfProfiler::now() : 0;
 
   // Execute instruction
-  dispatch(instruction, result);
+  m_decoded = &decoded;
+  dispatch(decoded.opcode, instruction, result);
 
-  // Store result
-  if (result.size)
+  if (decoded.opcode == llvm::Instruction::PHI && result.size)
   {
-    if (instruction->getOpcode() != llvm::Instruction::PHI)
-    {
-      setValue(instruction, result);
-    }
-    else
-    {
-      m_phiTemps[instruction] = result;
-    }
+    m_phiTemps.push_back(make_pair(decoded.valueID, result));
+  }
+
+  completeInstruction(decoded, result);
+
+  if (profiling)
+  {
+    // Include the plugin callbacks that the instruction triggered
+    SelfProfiler::recordOpcode(decoded.opcode, SelfProfiler::now() - start);
+  }
+}
+
+void WorkItem::completeConverged()
+{
+  const InterpreterCache::DecodedInstruction& decoded =
+    m_cache->getInstruction(m_position->currInst);
+  m_decoded = &decoded;
+
+  bool profiling = SelfProfiler::isEnabled();
+  uint64_t start = profiling ? SelfProfiler::now() : 0;
+
+  completeInstruction(decoded, m_values[decoded.valueID]);
+
+  if (profiling)
+  {
+    // The instruction was counted when the lanes executed it, so only add
+    // the time taken by the plugin callbacks that it triggered
+    SelfProfiler::recordOpcode(decoded.opcode, SelfProfiler::now() - start,
+                               0);
   }
 
+  // Operations executed in lock-step never change control flow
+  m_position->currInst++;
+}
+
+void WorkItem::completeInstruction(
+  const InterpreterCache::DecodedInstruction& decoded, const TypedValue& result)
+{
+  // Nothing else to do unless a plugin is observing this instruction (debug
+  // variables are only needed by the interactive debugger, which observes
+  // every instruction)
+  if (!m_context->isInstructionObserved(decoded.opcode))
+    return;
+
+  const llvm::Instruction* instruction = decoded.instruction;
+
 #if LLVM_VERSION >= 190
   // Handle debug records.
   if (auto* dbgMarker = instruction->DebugMarker)
@@ -347,6 +413,82 @@ void WorkItem::execute(const llvm::Instruction* instruction)
   m_context->notifyInstructionExecuted(this, instruction, result);
 }
 
+bool WorkItem::executeConverged(WorkItem* const* workItems, size_t num,
+                                size_t numLanes)
+{
+  const WorkItem* first = workItems[0];
+  const InterpreterCache* cache = first->m_cache;
+  const InterpreterCache::DecodedInstruction& decoded =
+    cache->getInstruction(first->m_position->currInst);
+  if (!decoded.laneFunction)
+    return false;
+
+  for (size_t i = 0; i < num; i++)
+  {
+    if (!workItems[i]->m_position->hasBegun)
+      return false;
+  }
+
+  bool profiling = SelfProfiler::isEnabled();
+  uint64_t start = profiling ? SelfProfiler::now() : 0;
+
+  const InterpreterCache::Operand& opA = cache->getOperand(decoded, 0);
+  const InterpreterCache::Operand& opB = cache->getOperand(decoded, 1);
+  if (num == numLanes)
+  {
+    for (size_t i = 0; i < num; i++)
+    {
+      workItems[i]->flushTemporaries();
+    }
+
+    // All lanes are active, so each value is contiguous across work-items
+    // and constants are shared between them
+    size_t strideA =
+      opA.kind == InterpreterCache::Operand::VALUE ? decoded.resultNum : 0;
+    size_t strideB =
+      opB.kind == InterpreterCache::Operand::VALUE ? decoded.resultNum : 0;
+    decoded.laneFunction(first->m_values[decoded.valueID].data,
+                         first->getOperand(opA).data, strideA,
+                         first->getOperand(opB).data, strideB, num,
+                         decoded.resultNum);
+  }
+  else
+  {
+    for (size_t i = 0; i < num; i++)
+    {
+      WorkItem* workItem = workItems[i];
+      workItem->flushTemporaries();
+      decoded.laneFunction(workItem->m_values[decoded.valueID].data,
+                           workItem->getOperand(opA).data, 0,
+                           workItem->getOperand(opB).data, 0, 1,
+                           decoded.resultNum);
+    }
+  }
+
+  if (profiling)
+  {
+    // Each work-item has executed the instruction once
+    SelfProfiler::recordOpcode(decoded.opcode, SelfProfiler::now() - start,
+                               num);
+  }
+
+  return true;
+}
+
+void WorkItem::flushTemporaries()
+{
+  // Commit results of preceding PHI nodes
+  for (auto& temp : m_phiTemps)
+  {
+    TypedValue& dest = m_values[temp.first];
+    memcpy(dest.data, temp.second.data, dest.size * dest.num);
+  }
+  m_phiTemps.clear();
+
+  // Temporary values from previous instructions are no longer needed
+  m_pool.reset();
+}
+
 const stack<const llvm::Instruction*>& WorkItem::getCallStack() const
 {
   return m_position->callStack;
@@ -359,7 +501,19 @@ const llvm::BasicBlock* WorkItem::getCurrentBlock() const
 
 const llvm::Instruction* WorkItem::getCurrentInstruction() const
 {
-  return &*m_position->currInst;
+  return m_cache->getInstruction(m_position->currInst).instruction;
+}
+
+unsigned WorkItem::getCurrentInstructionIndex() const
+{
+  return m_position->currInst;
+}
+
+TypedValue WorkItem::getCurrentOperand(unsigned index) const
+{
+  // Operands of the current instruction were resolved when it was decoded
+  assert(m_decoded && index < m_decoded->numOperands);
+  return getOperand(m_cache->getOperand(*m_decoded, index));
 }
 
 Size3 WorkItem::getGlobalID() const
@@ -395,34 +549,45 @@ Memory* WorkItem::getMemory(unsigned int addrSpace) const
 
 TypedValue WorkItem::getOperand(const llvm::Value* operand) const
 {
-  if (llvm::isa<llvm::Argument>(operand) ||
-      llvm::isa<llvm::GlobalVariable>(operand) ||
-      llvm::isa<llvm::Instruction>(operand))
+  // Operands of the current instruction have already been resolved
+  if (m_decoded)
   {
-    return getValue(operand);
+    for (unsigned i = 0; i < m_decoded->numOperands; i++)
+    {
+      const InterpreterCache::Operand& op = m_cache->getOperand(*m_decoded, i);
+      if (op.value == operand)
+        return getOperand(op);
+    }
   }
-  else if (llvm::isa<llvm::ConstantExpr>(operand))
+
+  return getOperand(m_cache->resolveOperand(operand));
+}
+
+TypedValue
+WorkItem::getOperand(const InterpreterCache::Operand& operand) const
+{
+  switch (operand.kind)
   {
-    pair<unsigned, unsigned> size = getValueSize(operand);
+  case InterpreterCache::Operand::VALUE:
+    return m_values[operand.index];
+  case InterpreterCache::Operand::CONSTANT:
+    return m_cache->getConstant(operand.index);
+  case InterpreterCache::Operand::CONSTEXPR:
+  {
+    const InterpreterCache::ConstExpr& expr =
+      m_cache->getConstantExpr(operand.index);
     TypedValue result;
-    result.size = size.first;
-    result.num = size.second;
-    result.data = m_pool.alloc(getTypeSize(operand->getType()));
+    result.size = expr.size;
+    result.num = expr.num;
+    result.data = m_pool.alloc(expr.allocSize);
 
     // Use of const_cast here is ugly, but ConstExpr instructions
     // shouldn't actually modify WorkItem state anyway
-    const_cast<WorkItem*>(this)->dispatch(m_cache->getConstantExpr(operand),
-                                          result);
+    const_cast<WorkItem*>(this)->dispatch(expr.instruction, result);
     return result;
   }
-  else if (llvm::isa<llvm::ConstantAggregate>(operand) ||
-           llvm::isa<llvm::ConstantData>(operand))
-  {
-    return m_cache->getConstant(operand);
-  }
-  else
-  {
-    FATAL_ERROR("Unhandled operand type: %5d", operand->getValueID());
+  default:
+    FATAL_ERROR("Unhandled operand type: %5d", operand.value->getValueID());
   }
 
   // Unreachable
@@ -458,6 +623,25 @@ const unsigned char* WorkItem::getValueData(const llvm::Value* value) const
   return getValue(value).data;
 }
 
+unsigned WorkItem::getValueID(const llvm::Value* value) const
+{
+  // The current instruction and its operands have already been resolved
+  if (m_decoded)
+  {
+    if (m_decoded->instruction == value)
+      return m_decoded->valueID;
+
+    for (unsigned i = 0; i < m_decoded->numOperands; i++)
+    {
+      const InterpreterCache::Operand& op = m_cache->getOperand(*m_decoded, i);
+      if (op.value == value && op.kind == InterpreterCache::Operand::VALUE)
+        return op.index;
+    }
+  }
+
+  return m_cache->getValueID(value);
+}
+
 const WorkGroup* WorkItem::getWorkGroup() const
 {
   return m_workGroup;
@@ -725,7 +909,8 @@ bool WorkItem::printValue(const llvm::Value* value) const
 
 void WorkItem::setValue(const llvm::Value* key, TypedValue value)
 {
-  m_values[m_cache->getValueID(key)] = value;
+  TypedValue& dest = m_values[m_cache->getValueID(key)];
+  memcpy(dest.data, value.data, dest.size * dest.num);
 }
 
 WorkItem::State WorkItem::step()
@@ -739,24 +924,25 @@ WorkItem::State WorkItem::step()
   }
 
   // Execute the next instruction
-  execute(&*m_position->currInst);
+  execute(m_cache->getInstruction(m_position->currInst));
 
-  // Check if we've reached the end of the block
-  if (++m_position->currInst == m_position->currBlock->end() ||
-      m_position->nextBlock)
+  if (m_position->nextInst != NO_BRANCH)
   {
-    if (m_position->nextBlock)
-    {
-      // Move to next basic block
-      m_position->prevBlock = m_position->currBlock;
-      m_position->currBlock = m_position->nextBlock;
-      m_position->nextBlock = NULL;
-      m_position->currInst = m_position->currBlock->begin();
-    }
+    // Move to next basic block
+    m_position->prevBlock = m_position->currBlock;
+    m_position->currInst = m_position->nextInst;
+    m_position->currBlock = m_cache->getInstruction(m_position->currInst).block;
+    m_position->nextInst = NO_BRANCH;
   }
-
-  if (m_state == FINISHED)
+  else if (m_state == FINISHED)
+  {
     m_context->notifyWorkItemComplete(this);
+  }
+  else
+  {
+    // Instructions within a basic block are contiguous in the stream
+    m_position->currInst++;
+  }
 
   return m_state;
 }
@@ -826,18 +1012,18 @@ INSTRUCTION(bitcast)
 
 INSTRUCTION(br)
 {
-  if (instruction->getNumOperands() == 1)
+  const InterpreterCache::DecodedInstruction& decoded =
+    m_cache->getInstruction(m_position->currInst);
+  if (decoded.numTargets == 1)
   {
     // Unconditional branch
-    m_position->nextBlock = (const llvm::BasicBlock*)instruction->getOperand(0);
+    m_position->nextInst = m_cache->getTarget(decoded, 0);
   }
   else
   {
     // Conditional branch
     bool pred = getOperand(instruction->getOperand(0)).getUInt();
-    const llvm::Value* iftrue = instruction->getOperand(2);
-    const llvm::Value* iffalse = instruction->getOperand(1);
-    m_position->nextBlock = (const llvm::BasicBlock*)(pred ? iftrue : iffalse);
+    m_position->nextInst = m_cache->getTarget(decoded, pred ? 1 : 0);
   }
 }
 
@@ -886,11 +1072,14 @@ INSTRUCTION(call)
   }
 
   // Check if function has definition
-  if (!function->isDeclaration())
+  const InterpreterCache::DecodedInstruction& decoded =
+    m_cache->getInstruction(m_position->currInst);
+  if (decoded.numTargets)
   {
-    m_position->callStack.push(&*m_position->currInst);
+    m_position->callStack.push(instruction);
+    m_position->callSites.push(m_position->currInst);
     m_position->allocations.push(list<size_t>());
-    m_position->nextBlock = &*function->begin();
+    m_position->nextInst = m_cache->getTarget(decoded, 0);
 
     // Set function arguments
     llvm::Function::const_arg_iterator argItr;
@@ -915,7 +1104,7 @@ INSTRUCTION(call)
       }
       else
       {
-        setValue(&*argItr, m_pool.clone(value));
+        setValue(&*argItr, value);
       }
     }
 
@@ -924,8 +1113,19 @@ INSTRUCTION(call)
 
   // Call builtin function
   InterpreterCache::Builtin builtin = m_cache->getBuiltin(function);
-  builtin.function.func(this, callInst, builtin.name, builtin.overload, result,
-                        builtin.function.op);
+  if (SelfProfiler::isEnabled())
+  {
+    uint64_t start = SelfProfiler::now();
+    builtin.function.func(this, callInst, builtin.name, builtin.overload,
+                          result, builtin.function.op);
+    SelfProfiler::recordBuiltin(function, builtin.name,
+                                SelfProfiler::now() - start);
+  }
+  else
+  {
+    builtin.function.func(this, callInst, builtin.name, builtin.overload,
+                          result, builtin.function.op);
+  }
 }
 
 INSTRUCTION(extractelem)
@@ -1339,16 +1539,17 @@ INSTRUCTION(ret)
 
   if (!m_position->callStack.empty())
   {
-    m_position->currInst =
-      llvm::BasicBlock::const_iterator(m_position->callStack.top());
-    m_position->currBlock = m_position->currInst->getParent();
+    // Resume execution after the call site
+    const llvm::Instruction* callInst = m_position->callStack.top();
+    m_position->nextInst = m_position->callSites.top() + 1;
     m_position->callStack.pop();
+    m_position->callSites.pop();
 
     // Set return value
     const llvm::Value* returnVal = retInst->getReturnValue();
     if (returnVal)
     {
-      setValue(&*m_position->currInst, m_pool.clone(getOperand(returnVal)));
+      setValue(callInst, getOperand(returnVal));
     }
 
     // Clear stack allocations
@@ -1362,7 +1563,7 @@ INSTRUCTION(ret)
   }
   else
   {
-    m_position->nextBlock = NULL;
+    m_position->nextInst = NO_BRANCH;
     m_state = FINISHED;
     m_workGroup->notifyFinished(this);
   }
@@ -1526,18 +1727,20 @@ INSTRUCTION(swtch)
   const llvm::Value* cond = swtch->getCondition();
   uint64_t val = getOperand(cond).getUInt();
 
-  // Look for case matching condition value
-  for (auto C : swtch->cases())
+  // Look for case matching condition value (target 0 is the default)
+  const InterpreterCache::DecodedInstruction& decoded =
+    m_cache->getInstruction(m_position->currInst);
+  for (unsigned i = 1; i < decoded.numTargets; i++)
   {
-    if (C.getCaseValue()->getZExtValue() == val)
+    if (m_cache->getCaseValue(decoded, i) == val)
     {
-      m_position->nextBlock = C.getCaseSuccessor();
+      m_position->nextInst = m_cache->getTarget(decoded, i);
       return;
     }
   }
 
   // No matching cases - use default
-  m_position->nextBlock = swtch->getDefaultDest();
+  m_position->nextInst = m_cache->getTarget(decoded, 0);
 }
 
 INSTRUCTION(udiv)
@@ -1614,6 +1817,7 @@ InterpreterCache::InterpreterCache(llvm::Function* kernel)
 
   set<llvm::Function*> processed;
   set<llvm::Function*> pending;
+  vector<llvm::Function*> functions;
 
   pending.insert(kernel);
 
@@ -1623,6 +1827,7 @@ InterpreterCache::InterpreterCache(llvm::Function* kernel)
     llvm::Function* function = *pending.begin();
     processed.insert(function);
     pending.erase(function);
+    functions.push_back(function);
 
     // Iterate through the function arguments
     llvm::Function::arg_iterator A;
@@ -1663,22 +1868,21 @@ InterpreterCache::InterpreterCache(llvm::Function* kernel)
       }
     }
   }
+
+  decodeFunctions(functions);
+  layoutValues();
 }
 
 InterpreterCache::~InterpreterCache()
 {
-  ConstantMap::iterator constItr;
-  for (constItr = m_constants.begin(); constItr != m_constants.end();
-       constItr++)
+  for (auto& constant : m_constants)
   {
-    delete[] constItr->second.data;
+    delete[] constant.data;
   }
 
-  ConstExprMap::iterator constExprItr;
-  for (constExprItr = m_constExpressions.begin();
-       constExprItr != m_constExpressions.end(); constExprItr++)
+  for (auto& expr : m_constExpressions)
   {
-    constExprItr->second->deleteValue();
+    expr.instruction->deleteValue();
   }
 }
 
@@ -1744,7 +1948,7 @@ InterpreterCache::getBuiltin(const llvm::Function* function) const
 void InterpreterCache::addConstant(const llvm::Value* value)
 {
   // Check if constant already in cache
-  if (m_constants.count(value))
+  if (m_constantIndices.count(value))
   {
     return;
   }
@@ -1757,27 +1961,310 @@ void InterpreterCache::addConstant(const llvm::Value* value)
   constant.data = new unsigned char[getTypeSize(value->getType())];
   getConstantData(constant.data, (const llvm::Constant*)value);
 
-  m_constants[value] = constant;
+  m_constantIndices[value] = m_constants.size();
+  m_constants.push_back(constant);
 }
 
 TypedValue InterpreterCache::getConstant(const llvm::Value* operand) const
 {
-  ConstantMap::const_iterator itr = m_constants.find(operand);
-  if (itr == m_constants.end())
+  ValueMap::const_iterator itr = m_constantIndices.find(operand);
+  if (itr == m_constantIndices.end())
   {
     FATAL_ERROR("Constant not found in cache (ID %d)", operand->getValueID());
   }
-  return itr->second;
+  return m_constants[itr->second];
 }
 
 const llvm::Instruction*
 InterpreterCache::getConstantExpr(const llvm::Value* expr) const
 {
-  ConstExprMap::const_iterator itr = m_constExpressions.find(expr);
-  if (itr == m_constExpressions.end())
+  ValueMap::const_iterator itr = m_constExprIndices.find(expr);
+  if (itr == m_constExprIndices.end())
   {
     FATAL_ERROR("Constant expression not found in cache");
   }
+  return m_constExpressions[itr->second].instruction;
+}
+
+InterpreterCache::Operand
+InterpreterCache::resolveOperand(const llvm::Value* value) const
+{
+  Operand operand = {value, Operand::OTHER, 0};
+  if (llvm::isa<llvm::Argument>(value) ||
+      llvm::isa<llvm::GlobalVariable>(value) ||
+      llvm::isa<llvm::Instruction>(value))
+  {
+    operand.kind = Operand::VALUE;
+    operand.index = getValueID(value);
+  }
+  else if (llvm::isa<llvm::ConstantExpr>(value))
+  {
+    ValueMap::const_iterator itr = m_constExprIndices.find(value);
+    if (itr == m_constExprIndices.end())
+    {
+      FATAL_ERROR("Constant expression not found in cache");
+    }
+    operand.kind = Operand::CONSTEXPR;
+    operand.index = itr->second;
+  }
+  else if (llvm::isa<llvm::ConstantAggregate>(value) ||
+           llvm::isa<llvm::ConstantData>(value))
+  {
+    ValueMap::const_iterator itr = m_constantIndices.find(value);
+    if (itr == m_constantIndices.end())
+    {
+      FATAL_ERROR("Constant not found in cache (ID %d)", value->getValueID());
+    }
+    operand.kind = Operand::CONSTANT;
+    operand.index = itr->second;
+  }
+  return operand;
+}
+
+namespace
+{
+template <typename T> struct LaneAdd
+{
+  T operator()(T a, T b) const { return a + b; }
+};
+template <typename T> struct LaneSub
+{
+  T operator()(T a, T b) const { return a - b; }
+};
+template <typename T> struct LaneMul
+{
+  // Promote to unsigned int to avoid signed overflow for narrow types
+  T operator()(T a, T b) const { return 1u * a * b; }
+};
+template <typename T> struct LaneFMul
+{
+  T operator()(T a, T b) const { return a * b; }
+};
+template <typename T> struct LaneAnd
+{
+  T operator()(T a, T b) const { return a & b; }
+};
+template <typename T> struct LaneOr
+{
+  T operator()(T a, T b) const { return a | b; }
+};
+template <typename T> struct LaneXor
+{
+  T operator()(T a, T b) const { return a ^ b; }
+};
+
+template <typename T, typename Op>
+static void executeLanes(unsigned char* result, const unsigned char* opA,
+                         size_t strideA, const unsigned char* opB,
+                         size_t strideB, size_t lanes, unsigned num)
+{
+  Op op;
+  T* r = (T*)result;
+  const T* a = (const T*)opA;
+  const T* b = (const T*)opB;
+  for (size_t l = 0; l < lanes; l++)
+  {
+    for (unsigned i = 0; i < num; i++)
+    {
+      r[l * num + i] = op(a[l * strideA + i], b[l * strideB + i]);
+    }
+  }
+}
+
+template <typename T>
+static InterpreterCache::LaneFunction getIntegerLaneFunction(unsigned opcode)
+{
+  switch (opcode)
+  {
+  case llvm::Instruction::Add:
+    return executeLanes<T, LaneAdd<T>>;
+  case llvm::Instruction::Sub:
+    return executeLanes<T, LaneSub<T>>;
+  case llvm::Instruction::Mul:
+    return executeLanes<T, LaneMul<T>>;
+  case llvm::Instruction::And:
+    return executeLanes<T, LaneAnd<T>>;
+  case llvm::Instruction::Or:
+    return executeLanes<T, LaneOr<T>>;
+  case llvm::Instruction::Xor:
+    return executeLanes<T, LaneXor<T>>;
+  default:
+    return NULL;
+  }
+}
+
+template <typename T>
+static InterpreterCache::LaneFunction getFloatLaneFunction(unsigned opcode)
+{
+  // Rounding the double precision results of the regular interpreter to
+  // single precision gives identical results for these operations
+  switch (opcode)
+  {
+  case llvm::Instruction::FAdd:
+    return executeLanes<T, LaneAdd<T>>;
+  case llvm::Instruction::FSub:
+    return executeLanes<T, LaneSub<T>>;
+  case llvm::Instruction::FMul:
+    return executeLanes<T, LaneFMul<T>>;
+  default:
+    return NULL;
+  }
+}
+
+static InterpreterCache::LaneFunction
+getLaneFunction(const llvm::Instruction* instruction)
+{
+  unsigned opcode = instruction->getOpcode();
+  const llvm::Type* type = instruction->getType()->getScalarType();
+  if (type->isIntegerTy(8))
+    return getIntegerLaneFunction<uint8_t>(opcode);
+  else if (type->isIntegerTy(16))
+    return getIntegerLaneFunction<uint16_t>(opcode);
+  else if (type->isIntegerTy(32))
+    return getIntegerLaneFunction<uint32_t>(opcode);
+  else if (type->isIntegerTy(64))
+    return getIntegerLaneFunction<uint64_t>(opcode);
+  else if (type->isFloatTy())
+    return getFloatLaneFunction<float>(opcode);
+  else if (type->isDoubleTy())
+    return getFloatLaneFunction<double>(opcode);
+  return NULL;
+}
+} // namespace
+
+void InterpreterCache::decodeFunctions(
+  const vector<llvm::Function*>& functions)
+{
+  // Lay out the instructions of every function in a single flat stream
+  unordered_map<const llvm::BasicBlock*, unsigned> blocks;
+  for (const llvm::Function* function : functions)
+  {
+    m_entryPoints[function] = m_instructions.size();
+    for (const llvm::BasicBlock& block : *function)
+    {
+      blocks[&block] = m_instructions.size();
+      for (const llvm::Instruction& instruction : block)
+      {
+        pair<unsigned, unsigned> size = getValueSize(&instruction);
+
+        DecodedInstruction decoded;
+        decoded.instruction = &instruction;
+        decoded.block = &block;
+        decoded.opcode = instruction.getOpcode();
+        decoded.valueID = getValueID(&instruction);
+        decoded.resultSize = size.first;
+        decoded.resultNum = size.second;
+        decoded.firstTarget = 0;
+        decoded.numTargets = 0;
+
+        decoded.firstOperand = m_operands.size();
+        for (auto O = instruction.value_op_begin();
+             O != instruction.value_op_end(); O++)
+        {
+          m_operands.push_back(resolveOperand(*O));
+        }
+        decoded.numOperands = m_operands.size() - decoded.firstOperand;
+
+        decoded.laneFunction = NULL;
+        if (decoded.numOperands == 2 &&
+            m_operands[decoded.firstOperand].kind != Operand::CONSTEXPR &&
+            m_operands[decoded.firstOperand].kind != Operand::OTHER &&
+            m_operands[decoded.firstOperand + 1].kind != Operand::CONSTEXPR &&
+            m_operands[decoded.firstOperand + 1].kind != Operand::OTHER)
+        {
+          decoded.laneFunction = getLaneFunction(&instruction);
+        }
+
+        m_instructions.push_back(decoded);
+      }
+    }
+  }
+
+  // Resolve successors now that every block has a position in the stream
+  for (DecodedInstruction& decoded : m_instructions)
+  {
+    decoded.firstTarget = m_targets.size();
+
+    const llvm::Instruction* instruction = decoded.instruction;
+    switch (decoded.opcode)
+    {
+    case llvm::Instruction::Br:
+    {
+      const llvm::BranchInst* br = (const llvm::BranchInst*)instruction;
+      if (br->isUnconditional())
+      {
+        addTarget(blocks.at(br->getSuccessor(0)));
+      }
+      else
+      {
+        // Conditional targets are stored as {iffalse, iftrue}
+        addTarget(blocks.at(br->getSuccessor(1)));
+        addTarget(blocks.at(br->getSuccessor(0)));
+      }
+      break;
+    }
+    case llvm::Instruction::Switch:
+    {
+      const llvm::SwitchInst* swtch = (const llvm::SwitchInst*)instruction;
+      addTarget(blocks.at(swtch->getDefaultDest()));
+      for (auto C : swtch->cases())
+      {
+        addTarget(blocks.at(C.getCaseSuccessor()),
+                  C.getCaseValue()->getZExtValue());
+      }
+      break;
+    }
+    case llvm::Instruction::Call:
+    {
+      const llvm::CallInst* call = (const llvm::CallInst*)instruction;
+      const llvm::Function* callee = call->getCalledFunction();
+      if (!callee)
+      {
+        // Resolve indirect function pointer
+        const llvm::Value* func = call->getCalledOperand();
+        func = ((const llvm::User*)func)->getOperand(0);
+        callee = (const llvm::Function*)func;
+      }
+      if (!callee->isDeclaration())
+      {
+        addTarget(getEntryPoint(callee));
+      }
+      break;
+    }
+    }
+
+    decoded.numTargets = m_targets.size() - decoded.firstTarget;
+  }
+}
+
+void InterpreterCache::addTarget(unsigned index, uint64_t caseValue)
+{
+  m_targets.push_back(index);
+  m_caseValues.push_back(caseValue);
+}
+
+shared_ptr<void> InterpreterCache::getAnalysis(const void* key) const
+{
+  auto itr = m_analyses.find(key);
+  if (itr == m_analyses.end())
+    return NULL;
+  return itr->second;
+}
+
+void InterpreterCache::setAnalysis(const void* key,
+                                   shared_ptr<void> analysis) const
+{
+  m_analyses[key] = analysis;
+}
+
+unsigned InterpreterCache::getEntryPoint(const llvm::Function* function) const
+{
+  EntryPointMap::const_iterator itr = m_entryPoints.find(function);
+  if (itr == m_entryPoints.end())
+  {
+    FATAL_ERROR("Function not found in cache: %s",
+                function->getName().str().c_str());
+  }
   return itr->second;
 }
 
@@ -1803,6 +2290,38 @@ unsigned InterpreterCache::getValueID(const llvm::Value* value) const
   return itr->second;
 }
 
+void InterpreterCache::layoutValues()
+{
+  // Assign each value a fixed, suitably aligned slot in the storage buffer
+  m_valueSlots.resize(m_valueIDs.size());
+  for (auto itr = m_valueIDs.begin(); itr != m_valueIDs.end(); itr++)
+  {
+    pair<unsigned, unsigned> size = getValueSize(itr->first);
+    m_valueSlots[itr->second] = {size.first, size.second, 0, 0};
+  }
+
+  // Slots are padded to a multiple of their alignment, so that the same
+  // offsets can be used when interleaving the values of many work-items
+  m_valueStorageSize = 0;
+  for (auto& slot : m_valueSlots)
+  {
+    size_t align = 1;
+    while (align < slot.size && align < sizeof(uint64_t))
+      align <<= 1;
+    if (m_valueStorageSize & (align - 1))
+      m_valueStorageSize += align - (m_valueStorageSize & (align - 1));
+
+    slot.offset = m_valueStorageSize;
+    slot.stride = slot.size * slot.num;
+    if (slot.stride & (align - 1))
+      slot.stride += align - (slot.stride & (align - 1));
+    m_valueStorageSize += slot.stride;
+  }
+  size_t padding = m_valueStorageSize % sizeof(uint64_t);
+  if (padding)
+    m_valueStorageSize += sizeof(uint64_t) - padding;
+}
+
 unsigned InterpreterCache::getNumValues() const
 {
   return m_valueIDs.size();
@@ -1825,13 +2344,21 @@ void InterpreterCache::addOperand(const llvm::Value* operand)
   {
     // Resolve constant expressions
     const llvm::ConstantExpr* expr = (const llvm::ConstantExpr*)operand;
-    if (!m_constExpressions.count(expr))
+    if (!m_constExprIndices.count(expr))
     {
       for (auto O = expr->op_begin(); O != expr->op_end(); O++)
       {
         addOperand(*O);
       }
-      m_constExpressions[expr] = getConstExprAsInstruction(expr);
+
+      pair<unsigned, unsigned> size = getValueSize(expr);
+      ConstExpr constExpr;
+      constExpr.instruction = getConstExprAsInstruction(expr);
+      constExpr.size = size.first;
+      constExpr.num = size.second;
+      constExpr.allocSize = getTypeSize(expr->getType());
+      m_constExprIndices[expr] = m_constExpressions.size();
+      m_constExpressions.push_back(constExpr);
       // TODO: Resolve actual value?
     }
   }
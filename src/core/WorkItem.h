@@ -6,6 +6,8 @@
 // license terms please see the LICENSE file distributed with this
 // source code.
 
+#pragma once
+
 #include "common.h"
 
 namespace llvm
@@ -58,6 +60,68 @@ public:
     std::string name, overload;
   };
 
+  // Executes a simple operation for a number of work-items (lanes), given
+  // the strides (in elements) between the operands of successive lanes
+  typedef void (*LaneFunction)(unsigned char* result, const unsigned char* opA,
+                               size_t strideA, const unsigned char* opB,
+                               size_t strideB, size_t lanes, unsigned num);
+
+  // Pre-decoded instruction, stored in a flat per-kernel instruction stream
+  // in which the instructions of each basic block are contiguous
+  struct DecodedInstruction
+  {
+    const llvm::Instruction* instruction;
+    const llvm::BasicBlock* block;
+    unsigned opcode;
+    unsigned valueID;
+    unsigned resultSize;
+    unsigned resultNum;
+
+    // Successor instructions (branches, switches and direct calls)
+    unsigned firstTarget;
+    unsigned numTargets;
+
+    // Pre-resolved operands
+    unsigned firstOperand;
+    unsigned numOperands;
+
+    // Implementation of simple operations for many work-items at once
+    LaneFunction laneFunction;
+  };
+
+  // Operand resolved to an index into the relevant value table
+  struct Operand
+  {
+    enum Kind
+    {
+      VALUE,
+      CONSTANT,
+      CONSTEXPR,
+      OTHER
+    };
+    const llvm::Value* value;
+    Kind kind;
+    unsigned index;
+  };
+
+  // Constant expression, evaluated as an instruction when used
+  struct ConstExpr
+  {
+    llvm::Instruction* instruction;
+    unsigned size;
+    unsigned num;
+    unsigned allocSize;
+  };
+
+  // Location of a value within the per-work-item value storage
+  struct ValueSlot
+  {
+    unsigned size;
+    unsigned num;
+    size_t offset;
+    size_t stride;
+  };
+
   InterpreterCache(llvm::Function* kernel);
   ~InterpreterCache();
 
@@ -66,26 +130,77 @@ public:
 
   void addConstant(const llvm::Value* constant);
   TypedValue getConstant(const llvm::Value* operand) const;
+  TypedValue getConstant(unsigned index) const { return m_constants[index]; }
   const llvm::Instruction* getConstantExpr(const llvm::Value* expr) const;
+  const ConstExpr& getConstantExpr(unsigned index) const
+  {
+    return m_constExpressions[index];
+  }
 
   unsigned addValueID(const llvm::Value* value);
   unsigned getValueID(const llvm::Value* value) const;
   unsigned getNumValues() const;
   bool hasValue(const llvm::Value* value) const;
+  const ValueSlot& getValueSlot(unsigned id) const { return m_valueSlots[id]; }
+  size_t getValueStorageSize() const { return m_valueStorageSize; }
+
+  unsigned getEntryPoint(const llvm::Function* function) const;
+  const DecodedInstruction& getInstruction(unsigned index) const
+  {
+    return m_instructions[index];
+  }
+  unsigned getNumInstructions() const { return m_instructions.size(); }
+  unsigned getTarget(const DecodedInstruction& instruction,
+                     unsigned index) const
+  {
+    return m_targets[instruction.firstTarget + index];
+  }
+  uint64_t getCaseValue(const DecodedInstruction& instruction,
+                        unsigned index) const
+  {
+    return m_caseValues[instruction.firstTarget + index];
+  }
+  const Operand& getOperand(const DecodedInstruction& instruction,
+                            unsigned index) const
+  {
+    return m_operands[instruction.firstOperand + index];
+  }
+  Operand resolveOperand(const llvm::Value* value) const;
+
+  // Results of analyses of the kernel made by plugins, which are released
+  // along with the cache (keyed by an address unique to each analysis)
+  std::shared_ptr<void> getAnalysis(const void* key) const;
+  void setAnalysis(const void* key, std::shared_ptr<void> analysis) const;
 
 private:
   typedef std::unordered_map<const llvm::Value*, unsigned> ValueMap;
   typedef std::unordered_map<const llvm::Function*, Builtin> BuiltinMap;
-  typedef std::unordered_map<const llvm::Value*, TypedValue> ConstantMap;
-  typedef std::unordered_map<const llvm::Value*, llvm::Instruction*>
-    ConstExprMap;
+  typedef std::unordered_map<const llvm::Function*, unsigned> EntryPointMap;
 
   BuiltinMap m_builtins;
-  ConstantMap m_constants;
-  ConstExprMap m_constExpressions;
   ValueMap m_valueIDs;
 
+  // Constants and constant expressions, indexed via the maps
+  std::vector<TypedValue> m_constants;
+  std::vector<ConstExpr> m_constExpressions;
+  ValueMap m_constantIndices;
+  ValueMap m_constExprIndices;
+
+  std::vector<DecodedInstruction> m_instructions;
+  std::vector<unsigned> m_targets;
+  std::vector<uint64_t> m_caseValues;
+  std::vector<Operand> m_operands;
+  EntryPointMap m_entryPoints;
+
+  std::vector<ValueSlot> m_valueSlots;
+  size_t m_valueStorageSize;
+
+  mutable std::map<const void*, std::shared_ptr<void>> m_analyses;
+
   void addOperand(const llvm::Value* value);
+  void addTarget(unsigned index, uint64_t caseValue = 0);
+  void decodeFunctions(const std::vector<llvm::Function*>& functions);
+  void layoutValues();
 };
 
 class WorkItem
@@ -107,23 +222,36 @@ public:
 
   void clearBarrier();
   void dispatch(const llvm::Instruction* instruction, TypedValue& result);
-  void execute(const llvm::Instruction* instruction);
+  void execute(const InterpreterCache::DecodedInstruction& instruction);
   const std::stack<const llvm::Instruction*>& getCallStack() const;
   const llvm::BasicBlock* getCurrentBlock() const;
   const llvm::Instruction* getCurrentInstruction() const;
+  unsigned getCurrentInstructionIndex() const;
+
+  // Operand of the current instruction, by its index in the operand list
+  // (avoids looking the operand up by value)
+  TypedValue getCurrentOperand(unsigned index) const;
+
   Size3 getGlobalID() const;
   size_t getGlobalIndex() const;
   Size3 getLocalID() const;
   TypedValue getOperand(const llvm::Value* operand) const;
+  TypedValue getOperand(const InterpreterCache::Operand& operand) const;
   const llvm::BasicBlock* getPreviousBlock() const;
   Memory* getPrivateMemory() const;
   State getState() const;
   const unsigned char* getValueData(const llvm::Value* value) const;
+  unsigned getValueID(const llvm::Value* value) const;
   const WorkGroup* getWorkGroup() const;
   void printExpression(std::string expr) const;
   bool printValue(const llvm::Value* value) const;
   State step();
 
+  // Lock-step execution of work-items positioned at the same instruction
+  static bool executeConverged(WorkItem* const* workItems, size_t num,
+                               size_t numLanes);
+  void completeConverged();
+
   // SPIR instructions
 private:
 #define INSTRUCTION(name)                                                      \
@@ -188,7 +316,7 @@ private:
   size_t m_globalIndex;
   Size3 m_globalID;
   Size3 m_localID;
-  TypedValueMap m_phiTemps;
+  std::vector<std::pair<unsigned, TypedValue>> m_phiTemps;
   VariableMap m_variables;
   const Context* m_context;
   const KernelInvocation* m_kernelInvocation;
@@ -199,10 +327,17 @@ private:
   State m_state;
   struct Position;
   Position* m_position;
+  const InterpreterCache::DecodedInstruction* m_decoded;
 
+  void completeInstruction(const InterpreterCache::DecodedInstruction& decoded,
+                           const TypedValue& result);
+  void flushTemporaries();
   Memory* getMemory(unsigned int addrSpace) const;
+  void dispatch(unsigned opcode, const llvm::Instruction* instruction,
+                TypedValue& result);
 
-  // Store for instruction results and other operand values
+  // Store for instruction results and other operand values, each of which
+  // occupies a fixed slot within the work-group's value storage
   std::vector<TypedValue> m_values;
   TypedValue getValue(const llvm::Value* key) const;
   bool hasValue(const llvm::Value* key) const;
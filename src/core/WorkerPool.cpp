@@ -0,0 +1,109 @@
+// WorkerPool.cpp (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#include "common.h"
+
+#include "WorkerPool.h"
+
+using namespace oclgrind;
+using namespace std;
+
+WorkerPool::WorkerPool()
+{
+  m_numWorkers = 0;
+  m_numRunning = 0;
+  m_job = 0;
+  m_shutdown = false;
+  m_cancelled = false;
+}
+
+WorkerPool::~WorkerPool()
+{
+  // Wake up parked threads and wait for them to exit
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_shutdown = true;
+  }
+  m_start.notify_all();
+
+  for (auto& thread : m_threads)
+  {
+    thread.join();
+  }
+}
+
+void WorkerPool::cancel()
+{
+  m_cancelled = true;
+}
+
+bool WorkerPool::isCancelled() const
+{
+  return m_cancelled;
+}
+
+void WorkerPool::run(unsigned numWorkers, function<void(int)> function)
+{
+  m_cancelled = false;
+
+  // Run directly on the calling thread if there is only a single worker
+  if (numWorkers <= 1)
+  {
+    function(0);
+    return;
+  }
+
+  {
+    lock_guard<mutex> lock(m_mutex);
+
+    // Create additional threads if necessary
+    while (m_threads.size() < numWorkers - 1)
+    {
+      m_threads.push_back(
+        thread(&WorkerPool::runThread, this, m_threads.size() + 1, m_job));
+    }
+
+    m_function = function;
+    m_numWorkers = numWorkers;
+    m_numRunning = numWorkers - 1;
+    m_job++;
+  }
+  m_start.notify_all();
+
+  // The calling thread acts as the first worker
+  function(0);
+
+  // Wait for the other workers to complete
+  unique_lock<mutex> lock(m_mutex);
+  m_finished.wait(lock, [this] { return m_numRunning == 0; });
+  m_function = nullptr;
+}
+
+void WorkerPool::runThread(int id, uint64_t job)
+{
+  unique_lock<mutex> lock(m_mutex);
+  while (true)
+  {
+    // Park until the next job is submitted
+    m_start.wait(lock, [&] { return m_shutdown || m_job != job; });
+    if (m_shutdown)
+      return;
+    job = m_job;
+
+    // Not every thread is needed for every job
+    if ((unsigned)id >= m_numWorkers)
+      continue;
+
+    lock.unlock();
+    m_function(id);
+    lock.lock();
+
+    if (--m_numRunning == 0)
+      m_finished.notify_one();
+  }
+}
@@ -0,0 +1,48 @@
+// WorkerPool.h (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace oclgrind
+{
+// Pool of worker threads that persist (parked) between jobs
+class WorkerPool
+{
+public:
+  WorkerPool();
+  virtual ~WorkerPool();
+
+  void cancel();
+  bool isCancelled() const;
+  void run(unsigned numWorkers, std::function<void(int)> function);
+
+private:
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;
+  std::condition_variable m_start;
+  std::condition_variable m_finished;
+
+  // Current job
+  std::function<void(int)> m_function;
+  unsigned m_numWorkers;
+  unsigned m_numRunning;
+  uint64_t m_job;
+  bool m_shutdown;
+  std::atomic<bool> m_cancelled;
+
+  void runThread(int id, uint64_t job);
+};
+} // namespace oclgrind
@@ -957,6 +957,10 @@ MemoryPool::~MemoryPool()
   {
     delete[] * itr;
   }
+  for (auto itr = m_oversized.begin(); itr != m_oversized.end(); itr++)
+  {
+    delete[] * itr;
+  }
 }
 
 uint8_t* MemoryPool::alloc(size_t size)
@@ -969,7 +973,7 @@ uint8_t* MemoryPool::alloc(size_t size)
   {
     // Oversized buffers allocated separately from main pool
     unsigned char* buffer = new unsigned char[size];
-    m_blocks.push_back(buffer);
+    m_oversized.push_back(buffer);
     return buffer;
   }
 
@@ -1010,4 +1014,24 @@ TypedValue MemoryPool::clone(const TypedValue& source)
   memcpy(dest.data, source.data, dest.size * dest.num);
   return dest;
 }
+
+void MemoryPool::reset()
+{
+  for (auto itr = m_oversized.begin(); itr != m_oversized.end(); itr++)
+  {
+    delete[] * itr;
+  }
+  m_oversized.clear();
+
+  if (m_blocks.empty())
+    return;
+
+  // Keep the most recently allocated block and release the others
+  while (m_blocks.size() > 1)
+  {
+    delete[] m_blocks.back();
+    m_blocks.pop_back();
+  }
+  m_offset = 0;
+}
 } // namespace oclgrind
@@ -242,10 +242,14 @@ public:
   uint8_t* alloc(size_t size);
   TypedValue clone(const TypedValue& source);
 
+  // Release all allocations, retaining the current block for reuse
+  void reset();
+
 private:
   size_t m_blockSize;
   size_t m_offset;
   std::list<uint8_t*> m_blocks;
+  std::list<uint8_t*> m_oversized;
 };
 
 // Pool allocator class for STL containers
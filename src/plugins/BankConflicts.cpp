@@ -0,0 +1,222 @@
+// BankConflicts.cpp (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#include "core/common.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "llvm/IR/Instruction.h"
+
+#include "BankConflicts.h"
+
+#include "core/Kernel.h"
+#include "core/KernelInvocation.h"
+#include "core/Memory.h"
+#include "core/WorkGroup.h"
+#include "core/WorkItem.h"
+
+using namespace oclgrind;
+using namespace std;
+
+THREAD_LOCAL BankConflicts::WorkerState BankConflicts::m_state = {NULL};
+
+BankConflicts::BankConflicts(const Context* context) : Plugin(context)
+{
+  m_simdWidth = getEnvInt("OCLGRIND_SIMD_WIDTH", 32, false);
+  m_numBanks = getEnvInt("OCLGRIND_LOCAL_MEM_BANKS", 32, false);
+  m_bankWidth = getEnvInt("OCLGRIND_LOCAL_MEM_BANK_WIDTH", 4, false);
+}
+
+Plugin::Subscription BankConflicts::getSubscribedEvents() const
+{
+  return (1 << KERNEL_BEGIN) | (1 << KERNEL_END) | (1 << MEMORY_LOAD) |
+         (1 << MEMORY_STORE) | (1 << WORK_GROUP_BEGIN) |
+         (1 << WORK_GROUP_COMPLETE);
+}
+
+void BankConflicts::addAccess(const WorkItem* workItem, size_t address,
+                              size_t size)
+{
+  Request& request =
+    m_state.requests->get(workItem, workItem->getCurrentInstruction());
+  request.accesses.push_back(
+    {m_state.requests->getLane(workItem), address, size});
+}
+
+size_t BankConflicts::getConflictDegree(const Request& request) const
+{
+  // Gather the distinct bank-sized words accessed by the lane group
+  vector<size_t> words;
+  for (const Access& access : request.accesses)
+  {
+    size_t last = (access.address + access.size - 1) / m_bankWidth;
+    for (size_t word = access.address / m_bankWidth; word <= last; word++)
+      words.push_back(word);
+  }
+  sort(words.begin(), words.end());
+  words.erase(unique(words.begin(), words.end()), words.end());
+
+  // Accesses to the same word are broadcast, so the degree of conflict is
+  // the largest number of distinct words that map to a single bank
+  vector<size_t> bankWords(m_numBanks);
+  size_t degree = 0;
+  for (size_t word : words)
+    degree = max(degree, ++bankWords[word % m_numBanks]);
+  return degree;
+}
+
+size_t BankConflicts::getStride(Request& request) const
+{
+  stable_sort(request.accesses.begin(), request.accesses.end(),
+              [](const Access& a, const Access& b) { return a.lane < b.lane; });
+
+  // Check that the first access of each lane is a constant stride from
+  // that of the previous lane
+  size_t stride = 0;
+  const Access* previous = &request.accesses.front();
+  for (const Access& access : request.accesses)
+  {
+    if (access.lane == previous->lane)
+      continue;
+
+    if (access.address <= previous->address)
+      return 0;
+
+    size_t lanes = access.lane - previous->lane;
+    size_t distance = access.address - previous->address;
+    if (distance % lanes || (stride && distance / lanes != stride))
+      return 0;
+
+    stride = distance / lanes;
+    previous = &access;
+  }
+  return stride;
+}
+
+void BankConflicts::kernelBegin(const KernelInvocation* kernelInvocation)
+{
+  m_lineStats.clear();
+}
+
+void BankConflicts::kernelEnd(const KernelInvocation* kernelInvocation)
+{
+  printStats(kernelInvocation);
+}
+
+void BankConflicts::memoryLoad(const Memory* memory, const WorkItem* workItem,
+                               size_t address, size_t size)
+{
+  if (memory->getAddressSpace() == AddrSpaceLocal)
+    addAccess(workItem, address, size);
+}
+
+void BankConflicts::memoryStore(const Memory* memory, const WorkItem* workItem,
+                                size_t address, size_t size,
+                                const uint8_t* storeData)
+{
+  if (memory->getAddressSpace() == AddrSpaceLocal)
+    addAccess(workItem, address, size);
+}
+
+static string formatRatio(size_t num, size_t den)
+{
+  ostringstream ratio;
+  ratio << fixed << setprecision(2) << (den ? (double)num / den : 0);
+  return ratio.str();
+}
+
+void BankConflicts::printStats(const KernelInvocation* kernelInvocation) const
+{
+  // Load default locale
+  locale previousLocale = cout.getloc();
+  locale defaultLocale("");
+  cout.imbue(defaultLocale);
+
+  cout << "Local memory bank conflicts for kernel '"
+       << kernelInvocation->getKernel()->getName() << "' (SIMD width "
+       << m_simdWidth << ", " << m_numBanks << " banks of " << m_bankWidth
+       << " bytes):" << endl;
+
+  cout << setw(16) << "Requests" << setw(16) << "Conflicted" << setw(12)
+       << "Avg Degree" << setw(12) << "Max Degree"
+       << "  Location" << endl;
+  printLineStats<LineStats>(
+    m_lineStats, [](const LineStats& stats) { return stats.conflicts; },
+    [](const LineStats& stats) {
+      cout << setw(16) << stats.requests << setw(16) << stats.conflicts
+           << setw(12) << formatRatio(stats.degrees, stats.requests)
+           << setw(12) << stats.maxDegree;
+    });
+
+  // Suggest padding for strides that map every lane to the same bank
+  for (auto& line : m_lineStats)
+  {
+    if (!line.second.paddingStride)
+      continue;
+
+    cout << endl
+         << line.first.first << ":" << line.first.second << ": stride of "
+         << line.second.paddingStride << " bytes between work-items is a "
+         << "multiple of the bank count, consider padding each row by "
+         << m_bankWidth << " bytes" << endl;
+  }
+
+  cout << endl;
+
+  // Restore locale
+  cout.imbue(previousLocale);
+}
+
+void BankConflicts::workGroupBegin(const WorkGroup* workGroup)
+{
+  // Create worker state if haven't already
+  if (!m_state.requests)
+    m_state.requests = new LaneGroupInstances<Request>(m_simdWidth);
+
+  m_state.requests->reset(workGroup);
+}
+
+void BankConflicts::workGroupComplete(const WorkGroup* workGroup)
+{
+  map<const llvm::Instruction*, LineStats> stats;
+  for (Request& request : m_state.requests->getInstances())
+  {
+    LineStats& instStats = stats[request.instruction];
+
+    size_t degree = getConflictDegree(request);
+    instStats.requests++;
+    instStats.degrees += degree;
+    instStats.maxDegree = max(instStats.maxDegree, degree);
+    if (degree <= 1)
+      continue;
+
+    instStats.conflicts++;
+
+    size_t stride = getStride(request);
+    if (stride && !(stride % ((size_t)m_numBanks * m_bankWidth)))
+      instStats.paddingStride = stride;
+  }
+
+  lock_guard<mutex> lock(m_mtx);
+
+  // Merge per-instruction statistics into their source lines
+  mergeLineStats(m_lineStats, stats);
+}
+
+BankConflicts::LineStats& BankConflicts::LineStats::operator+=(
+  const LineStats& other)
+{
+  requests += other.requests;
+  conflicts += other.conflicts;
+  degrees += other.degrees;
+  maxDegree = max(maxDegree, other.maxDegree);
+  if (other.paddingStride)
+    paddingStride = other.paddingStride;
+  return *this;
+}
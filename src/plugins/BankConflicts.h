@@ -0,0 +1,82 @@
+// BankConflicts.h (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#include "core/Plugin.h"
+
+#include <mutex>
+
+#include "LaneGroups.h"
+
+namespace oclgrind
+{
+class BankConflicts : public Plugin
+{
+public:
+  BankConflicts(const Context* context);
+
+  virtual void kernelBegin(const KernelInvocation* kernelInvocation) override;
+  virtual void kernelEnd(const KernelInvocation* kernelInvocation) override;
+  virtual void memoryLoad(const Memory* memory, const WorkItem* workItem,
+                          size_t address, size_t size) override;
+  virtual void memoryStore(const Memory* memory, const WorkItem* workItem,
+                           size_t address, size_t size,
+                           const uint8_t* storeData) override;
+  virtual void workGroupBegin(const WorkGroup* workGroup) override;
+  virtual void workGroupComplete(const WorkGroup* workGroup) override;
+
+  virtual Subscription getSubscribedEvents() const override;
+
+private:
+  struct Access
+  {
+    size_t lane;
+    size_t address;
+    size_t size;
+  };
+
+  // Accesses made by the work-items of one SIMD lane group when executing
+  // the same dynamic instance of a local memory instruction
+  struct Request
+  {
+    const llvm::Instruction* instruction;
+    std::vector<Access> accesses;
+  };
+
+  struct LineStats
+  {
+    size_t requests;
+    size_t conflicts;
+    size_t degrees;
+    size_t maxDegree;
+
+    // Stride between lanes that caused conflicts, if a multiple of the
+    // number of banks
+    size_t paddingStride;
+
+    LineStats& operator+=(const LineStats& other);
+  };
+
+  unsigned m_simdWidth;
+  unsigned m_numBanks;
+  unsigned m_bankWidth;
+
+  struct WorkerState
+  {
+    LaneGroupInstances<Request>* requests;
+  };
+  static THREAD_LOCAL WorkerState m_state;
+
+  std::mutex m_mtx;
+  std::map<SourceLine, LineStats> m_lineStats;
+
+  void addAccess(const WorkItem* workItem, size_t address, size_t size);
+  size_t getConflictDegree(const Request& request) const;
+  size_t getStride(Request& request) const;
+  void printStats(const KernelInvocation* kernelInvocation) const;
+};
+} // namespace oclgrind
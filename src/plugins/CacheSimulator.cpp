@@ -0,0 +1,254 @@
+// CacheSimulator.cpp (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#include "core/common.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "llvm/IR/Instruction.h"
+
+#include "CacheSimulator.h"
+
+#include "core/Kernel.h"
+#include "core/KernelInvocation.h"
+#include "core/Memory.h"
+#include "core/WorkGroup.h"
+#include "core/WorkItem.h"
+
+using namespace oclgrind;
+using namespace std;
+
+// Associativity of the modelled caches
+#define L1_WAYS 4
+#define L2_WAYS 16
+
+THREAD_LOCAL CacheSimulator::WorkerState CacheSimulator::m_state = {NULL};
+
+CacheSimulator::CacheSimulator(const Context* context) : Plugin(context)
+{
+  m_simdWidth = getEnvInt("OCLGRIND_SIMD_WIDTH", 32, false);
+  m_lineSize = getEnvInt("OCLGRIND_CACHE_LINE_SIZE", 128, false);
+  m_l1Size = getEnvInt("OCLGRIND_L1_CACHE_SIZE", 16384, false);
+  m_l2Size = getEnvInt("OCLGRIND_L2_CACHE_SIZE", 2097152, false);
+
+  m_l2 = new Cache(m_l2Size, m_lineSize, L2_WAYS);
+}
+
+CacheSimulator::~CacheSimulator()
+{
+  delete m_l2;
+}
+
+Plugin::Subscription CacheSimulator::getSubscribedEvents() const
+{
+  return (1 << KERNEL_BEGIN) | (1 << KERNEL_END) | (1 << MEMORY_LOAD) |
+         (1 << MEMORY_STORE) | (1 << WORK_GROUP_BEGIN) |
+         (1 << WORK_GROUP_COMPLETE);
+}
+
+void CacheSimulator::addAccess(const WorkItem* workItem, size_t address,
+                               size_t size, bool store)
+{
+  Request& request =
+    m_state.requests->get(workItem, workItem->getCurrentInstruction());
+  request.store = store;
+  request.accesses.push_back(make_pair(address, size));
+}
+
+void CacheSimulator::kernelBegin(const KernelInvocation* kernelInvocation)
+{
+  m_lineStats.clear();
+  m_l2->clear();
+}
+
+void CacheSimulator::kernelEnd(const KernelInvocation* kernelInvocation)
+{
+  printStats(kernelInvocation);
+}
+
+void CacheSimulator::memoryLoad(const Memory* memory, const WorkItem* workItem,
+                                size_t address, size_t size)
+{
+  if (memory->getAddressSpace() == AddrSpaceGlobal)
+    addAccess(workItem, address, size, false);
+}
+
+void CacheSimulator::memoryStore(const Memory* memory,
+                                 const WorkItem* workItem, size_t address,
+                                 size_t size, const uint8_t* storeData)
+{
+  if (memory->getAddressSpace() == AddrSpaceGlobal)
+    addAccess(workItem, address, size, true);
+}
+
+static string formatHitRate(size_t hits, size_t accesses)
+{
+  if (!accesses)
+    return "-";
+
+  ostringstream rate;
+  rate << fixed << setprecision(1) << (100.0 * hits / accesses) << "%";
+  return rate.str();
+}
+
+static string formatRatio(size_t num, size_t den)
+{
+  ostringstream ratio;
+  ratio << fixed << setprecision(2) << (den ? (double)num / den : 0);
+  return ratio.str();
+}
+
+void CacheSimulator::printStats(const KernelInvocation* kernelInvocation) const
+{
+  // Load default locale
+  locale previousLocale = cout.getloc();
+  locale defaultLocale("");
+  cout.imbue(defaultLocale);
+
+  cout << "Global memory transactions for kernel '"
+       << kernelInvocation->getKernel()->getName() << "' (SIMD width "
+       << m_simdWidth << ", " << m_lineSize << " byte lines):" << endl;
+
+  cout << setw(16) << "Requests" << setw(12) << "Trans/Req" << setw(10)
+       << "L1 Hits" << setw(10) << "L2 Hits" << setw(16) << "Wasted Bytes"
+       << "  Location" << endl;
+  printLineStats<LineStats>(
+    m_lineStats, [](const LineStats& stats) { return stats.transactions; },
+    [this](const LineStats& stats) {
+      cout << setw(16) << stats.requests << setw(12)
+           << formatRatio(stats.transactions, stats.requests) << setw(10)
+           << formatHitRate(stats.l1Hits, stats.l1Accesses) << setw(10)
+           << formatHitRate(stats.l2Hits, stats.l2Accesses) << setw(16)
+           << (stats.transactions * m_lineSize - stats.usefulBytes);
+    });
+
+  cout << endl;
+
+  // Restore locale
+  cout.imbue(previousLocale);
+}
+
+void CacheSimulator::workGroupBegin(const WorkGroup* workGroup)
+{
+  // Create worker state if haven't already
+  if (!m_state.requests)
+  {
+    m_state.requests = new LaneGroupInstances<Request>(m_simdWidth);
+    m_state.l1 = new Cache(m_l1Size, m_lineSize, L1_WAYS);
+  }
+
+  // Each work-group starts with a cold L1 cache
+  m_state.requests->reset(workGroup);
+  m_state.l1->clear();
+}
+
+void CacheSimulator::workGroupComplete(const WorkGroup* workGroup)
+{
+  map<const llvm::Instruction*, LineStats> stats;
+  vector<pair<const llvm::Instruction*, size_t>> l2Accesses;
+
+  // Coalesce each request into line-sized transactions, in the order that
+  // the requests were issued, and pass them through the L1 cache
+  vector<size_t> lines;
+  for (Request& request : m_state.requests->getInstances())
+  {
+    LineStats& instStats = stats[request.instruction];
+    instStats.requests++;
+
+    sort(request.accesses.begin(), request.accesses.end());
+
+    lines.clear();
+    size_t end = 0;
+    for (auto& access : request.accesses)
+    {
+      // Count each byte requested once, even if several work-items load it
+      size_t begin = max(access.first, end);
+      end = max(end, access.first + access.second);
+      if (end > begin)
+        instStats.usefulBytes += end - begin;
+
+      size_t last = (access.first + access.second - 1) / m_lineSize;
+      for (size_t line = access.first / m_lineSize; line <= last; line++)
+        lines.push_back(line);
+    }
+    sort(lines.begin(), lines.end());
+    lines.erase(unique(lines.begin(), lines.end()), lines.end());
+    instStats.transactions += lines.size();
+
+    // Stores write through to L2 without allocating lines in L1
+    for (size_t line : lines)
+    {
+      if (!request.store)
+      {
+        instStats.l1Accesses++;
+        if (m_state.l1->access(line))
+        {
+          instStats.l1Hits++;
+          continue;
+        }
+      }
+      l2Accesses.push_back(make_pair(request.instruction, line));
+    }
+  }
+
+  lock_guard<mutex> lock(m_mtx);
+
+  // The L2 cache is shared by all work-groups
+  for (auto& access : l2Accesses)
+  {
+    LineStats& instStats = stats[access.first];
+    instStats.l2Accesses++;
+    if (m_l2->access(access.second))
+      instStats.l2Hits++;
+  }
+
+  // Merge per-instruction statistics into their source lines
+  mergeLineStats(m_lineStats, stats);
+}
+
+CacheSimulator::LineStats& CacheSimulator::LineStats::operator+=(
+  const LineStats& other)
+{
+  requests += other.requests;
+  transactions += other.transactions;
+  usefulBytes += other.usefulBytes;
+  l1Accesses += other.l1Accesses;
+  l1Hits += other.l1Hits;
+  l2Accesses += other.l2Accesses;
+  l2Hits += other.l2Hits;
+  return *this;
+}
+
+CacheSimulator::Cache::Cache(size_t size, size_t lineSize, unsigned ways)
+{
+  m_ways = ways;
+  m_numSets = max<size_t>(size / (lineSize * ways), 1);
+  m_lines.resize(m_numSets * m_ways);
+}
+
+bool CacheSimulator::Cache::access(size_t line)
+{
+  // Lines are stored plus one, so that zero marks an empty way
+  size_t* set = m_lines.data() + (line % m_numSets) * m_ways;
+  unsigned way = 0;
+  while (way < m_ways - 1 && set[way] != line + 1)
+    way++;
+  bool hit = (set[way] == line + 1);
+
+  // Move line to the front of the set, evicting the oldest line on a miss
+  memmove(set + 1, set, way * sizeof(size_t));
+  set[0] = line + 1;
+
+  return hit;
+}
+
+void CacheSimulator::Cache::clear()
+{
+  fill(m_lines.begin(), m_lines.end(), 0);
+}
@@ -0,0 +1,95 @@
+// CacheSimulator.h (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#include "core/Plugin.h"
+
+#include <mutex>
+
+#include "LaneGroups.h"
+
+namespace oclgrind
+{
+class CacheSimulator : public Plugin
+{
+public:
+  CacheSimulator(const Context* context);
+  virtual ~CacheSimulator();
+
+  virtual void kernelBegin(const KernelInvocation* kernelInvocation) override;
+  virtual void kernelEnd(const KernelInvocation* kernelInvocation) override;
+  virtual void memoryLoad(const Memory* memory, const WorkItem* workItem,
+                          size_t address, size_t size) override;
+  virtual void memoryStore(const Memory* memory, const WorkItem* workItem,
+                           size_t address, size_t size,
+                           const uint8_t* storeData) override;
+  virtual void workGroupBegin(const WorkGroup* workGroup) override;
+  virtual void workGroupComplete(const WorkGroup* workGroup) override;
+
+  virtual Subscription getSubscribedEvents() const override;
+
+private:
+  // Set-associative cache with LRU replacement, addressed by line number
+  class Cache
+  {
+  public:
+    Cache(size_t size, size_t lineSize, unsigned ways);
+
+    bool access(size_t line);
+    void clear();
+
+  private:
+    unsigned m_ways;
+    size_t m_numSets;
+
+    // Lines held by each set, most recently used first
+    std::vector<size_t> m_lines;
+  };
+
+  // Accesses made by the work-items of one SIMD lane group when executing
+  // the same dynamic instance of a global memory instruction
+  struct Request
+  {
+    const llvm::Instruction* instruction;
+    bool store;
+    std::vector<std::pair<size_t, size_t>> accesses;
+  };
+
+  struct LineStats
+  {
+    size_t requests;
+    size_t transactions;
+    size_t usefulBytes;
+    size_t l1Accesses;
+    size_t l1Hits;
+    size_t l2Accesses;
+    size_t l2Hits;
+
+    LineStats& operator+=(const LineStats& other);
+  };
+
+  unsigned m_simdWidth;
+  size_t m_lineSize;
+  size_t m_l1Size;
+  size_t m_l2Size;
+
+  struct WorkerState
+  {
+    LaneGroupInstances<Request>* requests;
+    Cache* l1;
+  };
+  static THREAD_LOCAL WorkerState m_state;
+
+  std::mutex m_mtx;
+  Cache* m_l2;
+  std::map<SourceLine, LineStats> m_lineStats;
+
+  void addAccess(const WorkItem* workItem, size_t address, size_t size,
+                 bool store);
+  void printStats(const KernelInvocation* kernelInvocation) const;
+};
+} // namespace oclgrind
@@ -0,0 +1,194 @@
+// DivergenceProfiler.cpp (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#include "core/common.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "llvm/IR/Instructions.h"
+
+#include "DivergenceProfiler.h"
+
+#include "core/Kernel.h"
+#include "core/KernelInvocation.h"
+#include "core/WorkGroup.h"
+#include "core/WorkItem.h"
+
+using namespace oclgrind;
+using namespace std;
+
+THREAD_LOCAL DivergenceProfiler::WorkerState DivergenceProfiler::m_state = {
+  NULL};
+
+DivergenceProfiler::DivergenceProfiler(const Context* context)
+    : Plugin(context)
+{
+  m_simdWidth = getEnvInt("OCLGRIND_SIMD_WIDTH", 32, false);
+}
+
+Plugin::Subscription DivergenceProfiler::getSubscribedEvents() const
+{
+  // Only block terminators that can be reached by the interpreter are
+  // observed
+  return Subscription((1 << INSTRUCTION_EXECUTED) | (1 << KERNEL_BEGIN) |
+                      (1 << KERNEL_END) | (1 << WORK_GROUP_BEGIN) |
+                      (1 << WORK_GROUP_COMPLETE),
+                      {llvm::Instruction::Br, llvm::Instruction::Switch,
+                       llvm::Instruction::Ret});
+}
+
+void DivergenceProfiler::instructionExecuted(
+  const WorkItem* workItem, const llvm::Instruction* instruction,
+  const TypedValue& result)
+{
+  // Only block terminators are of interest
+  if (!instruction->isTerminator())
+    return;
+
+  // Determine which successor this work-item will branch to
+  unsigned target = 0;
+  if (auto branch = llvm::dyn_cast<llvm::BranchInst>(instruction))
+  {
+    if (branch->isConditional())
+    {
+      // The condition is the first operand of a conditional branch
+      bool pred = workItem->getCurrentOperand(0).getUInt();
+      target = pred ? 0 : 1;
+    }
+  }
+  else if (auto swtch = llvm::dyn_cast<llvm::SwitchInst>(instruction))
+  {
+    uint64_t value = workItem->getCurrentOperand(0).getUInt();
+    for (auto c : swtch->cases())
+    {
+      if (c.getCaseValue()->getZExtValue() == value)
+      {
+        target = c.getSuccessorIndex();
+        break;
+      }
+    }
+  }
+
+  // Work-items within a lane group are matched up by how many times each of
+  // them has already executed this block
+  BlockInstance& instance = m_state.instances->get(workItem, instruction);
+  instance.lanes++;
+  if (find(instance.targets.begin(), instance.targets.end(), target) ==
+      instance.targets.end())
+  {
+    instance.targets.push_back(target);
+  }
+}
+
+void DivergenceProfiler::kernelBegin(const KernelInvocation* kernelInvocation)
+{
+  m_branchStats.clear();
+  m_activeLanes = 0;
+  m_laneSlots = 0;
+}
+
+void DivergenceProfiler::kernelEnd(const KernelInvocation* kernelInvocation)
+{
+  printStats(kernelInvocation);
+}
+
+static string formatPercentage(size_t num, size_t total)
+{
+  if (!total)
+    return "-";
+
+  ostringstream percentage;
+  percentage << fixed << setprecision(1) << (100.0 * num / total) << "%";
+  return percentage.str();
+}
+
+void DivergenceProfiler::printStats(
+  const KernelInvocation* kernelInvocation) const
+{
+  // Load default locale
+  locale previousLocale = cout.getloc();
+  locale defaultLocale("");
+  cout.imbue(defaultLocale);
+
+  cout << "Branch divergence for kernel '"
+       << kernelInvocation->getKernel()->getName() << "' (SIMD width "
+       << m_simdWidth << "):" << endl;
+
+  cout << setw(16) << "Branches" << setw(16) << "Divergent" << setw(12)
+       << "Rate" << setw(12) << "SIMD Eff."
+       << "  Location" << endl;
+  printLineStats<BranchStats>(
+    m_branchStats, [](const BranchStats& stats) { return stats.divergent; },
+    [](const BranchStats& stats) {
+      cout << setw(16) << stats.branches << setw(16) << stats.divergent
+           << setw(12) << formatPercentage(stats.divergent, stats.branches)
+           << setw(12) << formatPercentage(stats.lanes, stats.slots);
+    });
+
+  cout << "Estimated SIMD efficiency: "
+       << formatPercentage(m_activeLanes, m_laneSlots) << endl;
+
+  cout << endl;
+
+  // Restore locale
+  cout.imbue(previousLocale);
+}
+
+void DivergenceProfiler::workGroupBegin(const WorkGroup* workGroup)
+{
+  // Create worker state if haven't already
+  if (!m_state.instances)
+    m_state.instances = new LaneGroupInstances<BlockInstance>(m_simdWidth);
+
+  m_state.instances->reset(workGroup);
+}
+
+void DivergenceProfiler::workGroupComplete(const WorkGroup* workGroup)
+{
+  map<const llvm::Instruction*, BranchStats> stats;
+  size_t activeLanes = 0;
+  size_t laneSlots = 0;
+  for (const BlockInstance& instance : m_state.instances->getInstances())
+  {
+    // Each block is issued once for the whole lane group, with inactive
+    // lanes masked off
+    size_t blockSize = instance.instruction->getParent()->size();
+    activeLanes += instance.lanes * blockSize;
+    laneSlots += m_simdWidth * blockSize;
+
+    if (instance.instruction->getNumSuccessors() < 2)
+      continue;
+
+    // Divergent lane groups execute each path taken in turn
+    BranchStats& branchStats = stats[instance.instruction];
+    branchStats.branches++;
+    branchStats.lanes += instance.lanes;
+    branchStats.slots += m_simdWidth * instance.targets.size();
+    if (instance.targets.size() > 1)
+      branchStats.divergent++;
+  }
+
+  lock_guard<mutex> lock(m_mtx);
+
+  m_activeLanes += activeLanes;
+  m_laneSlots += laneSlots;
+
+  // Merge per-branch statistics into their source lines
+  mergeLineStats(m_branchStats, stats);
+}
+
+DivergenceProfiler::BranchStats& DivergenceProfiler::BranchStats::operator+=(
+  const BranchStats& other)
+{
+  branches += other.branches;
+  divergent += other.divergent;
+  lanes += other.lanes;
+  slots += other.slots;
+  return *this;
+}
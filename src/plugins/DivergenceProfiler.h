@@ -0,0 +1,71 @@
+// DivergenceProfiler.h (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#include "core/Plugin.h"
+
+#include <mutex>
+
+#include "LaneGroups.h"
+
+namespace oclgrind
+{
+class DivergenceProfiler : public Plugin
+{
+public:
+  DivergenceProfiler(const Context* context);
+
+  virtual void instructionExecuted(const WorkItem* workItem,
+                                   const llvm::Instruction* instruction,
+                                   const TypedValue& result) override;
+  virtual void kernelBegin(const KernelInvocation* kernelInvocation) override;
+  virtual void kernelEnd(const KernelInvocation* kernelInvocation) override;
+  virtual void workGroupBegin(const WorkGroup* workGroup) override;
+  virtual void workGroupComplete(const WorkGroup* workGroup) override;
+
+  virtual Subscription getSubscribedEvents() const override;
+
+private:
+  // Execution of a basic block by the work-items of one SIMD lane group,
+  // identified by the terminator instruction that ends the block
+  struct BlockInstance
+  {
+    const llvm::Instruction* instruction;
+    size_t lanes;
+
+    // Distinct successors taken by the lane group
+    std::vector<unsigned> targets;
+  };
+
+  struct BranchStats
+  {
+    size_t branches;
+    size_t divergent;
+    size_t lanes;
+    size_t slots;
+
+    BranchStats& operator+=(const BranchStats& other);
+  };
+
+  unsigned m_simdWidth;
+
+  struct WorkerState
+  {
+    LaneGroupInstances<BlockInstance>* instances;
+  };
+  static THREAD_LOCAL WorkerState m_state;
+
+  std::mutex m_mtx;
+  std::map<SourceLine, BranchStats> m_branchStats;
+
+  // Instructions executed by active lanes, and lane slots issued
+  size_t m_activeLanes;
+  size_t m_laneSlots;
+
+  void printStats(const KernelInvocation* kernelInvocation) const;
+};
+} // namespace oclgrind
@@ -6,19 +6,25 @@
 // license terms please see the LICENSE file distributed with this
 // source code.
 
+#include "config.h"
 #include "core/common.h"
 
+#include <fstream>
 #include <sstream>
 
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Type.h"
 
 #include "InstructionCounter.h"
 
 #include "core/Kernel.h"
 #include "core/KernelInvocation.h"
+#include "core/Program.h"
+#include "core/WorkItem.h"
 
 using namespace oclgrind;
 using namespace std;
@@ -30,6 +36,75 @@ using namespace std;
 THREAD_LOCAL InstructionCounter::WorkerState InstructionCounter::m_state = {
   NULL};
 
+mutex InstructionCounter::m_profileMutex;
+map<InstructionCounter::LineKey, InstructionCounter::LineProfile>
+  InstructionCounter::m_lineProfile;
+map<InstructionCounter::BlockKey, InstructionCounter::BlockProfile>
+  InstructionCounter::m_blockProfile;
+
+mutex InstructionCounter::m_statsMutex;
+ofstream InstructionCounter::m_statsStream;
+bool InstructionCounter::m_statsOpened = false;
+
+InstructionCounter::InstructionCounter(const Context* context)
+    : Plugin(context)
+{
+  m_printCounts = checkEnv("OCLGRIND_INST_COUNTS");
+
+  m_profileFile = getenv("OCLGRIND_PROFILE");
+  m_profileFormat = CALLGRIND;
+  const char* format = getenv("OCLGRIND_PROFILE_FORMAT");
+  if (format && !strcmp(format, "json"))
+    m_profileFormat = JSON;
+  else if (format && strcmp(format, "callgrind"))
+  {
+    cerr << endl
+         << "Oclgrind: Invalid value for OCLGRIND_PROFILE_FORMAT" << endl;
+    abort();
+  }
+
+  m_statsFile = getenv("OCLGRIND_STATS");
+  m_statsFormat = STATS_JSON;
+  format = getenv("OCLGRIND_STATS_FORMAT");
+  if (format && !strcmp(format, "csv"))
+    m_statsFormat = STATS_CSV;
+  else if (format && strcmp(format, "json"))
+  {
+    cerr << endl << "Oclgrind: Invalid value for OCLGRIND_STATS_FORMAT" << endl;
+    abort();
+  }
+
+  if (m_statsFile)
+  {
+    lock_guard<mutex> lock(m_statsMutex);
+    if (!m_statsOpened)
+    {
+      m_statsOpened = true;
+      m_statsStream.open(m_statsFile);
+      if (!m_statsStream.good())
+      {
+        cerr << "Oclgrind: Unable to open statistics file '" << m_statsFile
+             << "'" << endl;
+      }
+      else if (m_statsFormat == STATS_CSV)
+      {
+        m_statsStream << "kernel,work_dim,global_size,local_size,"
+                      << "global_offset,instructions";
+        for (unsigned addrSpace = 0; addrSpace < 4; addrSpace++)
+        {
+          const char* name = getAddressSpaceName(addrSpace);
+          m_statsStream << "," << name << "_load_bytes," << name
+                        << "_store_bytes";
+        }
+        m_statsStream << ",atomics,barriers,wall_time,"
+                      << "instructions_per_second,instruction_mix" << endl;
+      }
+    }
+    if (!m_statsStream.good())
+      m_statsFile = NULL;
+  }
+}
+
 static bool compareNamedCount(pair<string, size_t> a, pair<string, size_t> b)
 {
   if (a.second > b.second)
@@ -40,6 +115,16 @@ static bool compareNamedCount(pair<string, size_t> a, pair<string, size_t> b)
     return a.first < b.first;
 }
 
+Plugin::Subscription InstructionCounter::getSubscribedEvents() const
+{
+  EventMask events = (1 << INSTRUCTION_EXECUTED) | (1 << KERNEL_BEGIN) |
+                     (1 << KERNEL_END) | (1 << WORK_GROUP_BEGIN) |
+                     (1 << WORK_GROUP_COMPLETE);
+  if (m_statsFile)
+    events |= (1 << MEMORY_ATOMIC_LOAD) | (1 << WORK_GROUP_BARRIER);
+  return events;
+}
+
 string InstructionCounter::getOpcodeName(unsigned opcode) const
 {
   if (opcode >= COUNTED_CALL_BASE)
@@ -87,6 +172,20 @@ void InstructionCounter::instructionExecuted(
   const WorkItem* workItem, const llvm::Instruction* instruction,
   const TypedValue& result)
 {
+  if (m_profileFile)
+  {
+    // Count executions of each instruction for the source-line profile
+    unsigned index = workItem->getCurrentInstructionIndex();
+    if (index >= m_state.profileCounts->size())
+    {
+      m_state.profileCounts->resize(index + 1);
+    }
+    (*m_state.profileCounts)[index]++;
+  }
+
+  if (!m_printCounts && !m_statsFile)
+    return;
+
   unsigned opcode = instruction->getOpcode();
 
   // Check for loads and stores
@@ -152,9 +251,46 @@ void InstructionCounter::kernelBegin(const KernelInvocation* kernelInvocation)
   m_memopBytes.resize(16);
 
   m_functions.clear();
+
+  m_profileCounts.clear();
+
+  m_atomics = 0;
+  m_barriers = 0;
+  m_kernelStartTime = chrono::steady_clock::now();
 }
 
 void InstructionCounter::kernelEnd(const KernelInvocation* kernelInvocation)
+{
+  // Write statistics first, so that the wall time excludes other output
+  if (m_statsFile)
+  {
+    writeStats(kernelInvocation);
+  }
+
+  if (m_printCounts)
+  {
+    printCounts(kernelInvocation);
+  }
+
+  if (m_profileFile)
+  {
+    lock_guard<mutex> lock(m_profileMutex);
+    updateProfile(kernelInvocation);
+    writeProfile();
+  }
+}
+
+void InstructionCounter::memoryAtomicLoad(const Memory* memory,
+                                          const WorkItem* workItem,
+                                          AtomicOp op, size_t address,
+                                          size_t size)
+{
+  // Every atomic operation loads from memory exactly once
+  m_state.atomics++;
+}
+
+void InstructionCounter::printCounts(
+  const KernelInvocation* kernelInvocation) const
 {
   // Load default locale
   locale previousLocale = cout.getloc();
@@ -207,6 +343,7 @@ void InstructionCounter::workGroupBegin(const WorkGroup* workGroup)
     m_state.instCounts = new vector<size_t>;
     m_state.memopBytes = new vector<size_t>;
     m_state.functions = new vector<const llvm::Function*>;
+    m_state.profileCounts = new vector<size_t>;
   }
 
   m_state.instCounts->clear();
@@ -216,6 +353,17 @@ void InstructionCounter::workGroupBegin(const WorkGroup* workGroup)
   m_state.memopBytes->resize(16);
 
   m_state.functions->clear();
+
+  m_state.profileCounts->clear();
+
+  m_state.atomics = 0;
+  m_state.barriers = 0;
+}
+
+void InstructionCounter::workGroupBarrier(const WorkGroup* workGroup,
+                                          uint32_t flags)
+{
+  m_state.barriers++;
 }
 
 void InstructionCounter::workGroupComplete(const WorkGroup* workGroup)
@@ -255,4 +403,300 @@ void InstructionCounter::workGroupComplete(const WorkGroup* workGroup)
   // Merge memory transfer sizes into global list
   for (unsigned i = 0; i < m_state.memopBytes->size(); i++)
     m_memopBytes[i] += m_state.memopBytes->at(i);
+
+  // Merge per-instruction execution counts
+  if (m_state.profileCounts->size() > m_profileCounts.size())
+    m_profileCounts.resize(m_state.profileCounts->size());
+  for (unsigned i = 0; i < m_state.profileCounts->size(); i++)
+    m_profileCounts[i] += m_state.profileCounts->at(i);
+
+  m_atomics += m_state.atomics;
+  m_barriers += m_state.barriers;
+}
+
+void InstructionCounter::updateProfile(const KernelInvocation* kernelInvocation)
+{
+  const Kernel* kernel = kernelInvocation->getKernel();
+  const InterpreterCache* cache =
+    kernel->getProgram()->getInterpreterCache(kernel->getFunction());
+
+  map<const llvm::BasicBlock*, unsigned> blockIndices;
+  for (unsigned i = 0; i < m_profileCounts.size(); i++)
+  {
+    size_t count = m_profileCounts[i];
+    if (!count)
+      continue;
+
+    const InterpreterCache::DecodedInstruction& decoded =
+      cache->getInstruction(i);
+    const llvm::Instruction* instruction = decoded.instruction;
+    const llvm::BasicBlock* block = decoded.block;
+    const llvm::Function* function = block->getParent();
+    string functionName = function->getName().str();
+
+    // Get source location, if available
+    string filename = "???";
+    unsigned line = 0;
+    if (const llvm::DILocation* loc = instruction->getDebugLoc().get())
+    {
+      filename = loc->getFilename().str();
+      line = loc->getLine();
+    }
+
+    // Number basic blocks in program order within their function
+    if (!blockIndices.count(block))
+    {
+      unsigned index = 0;
+      for (const llvm::BasicBlock& B : *function)
+        blockIndices[&B] = index++;
+    }
+
+    BlockProfile& blockProfile =
+      m_blockProfile[BlockKey(functionName, blockIndices[block])];
+    if (instruction == &block->front())
+    {
+      blockProfile.name = block->getName().str();
+      blockProfile.executions += count;
+    }
+    if (!blockProfile.line)
+      blockProfile.line = line;
+
+    if (llvm::isa<llvm::DbgInfoIntrinsic>(instruction))
+      continue;
+
+    blockProfile.instructions += count;
+
+    LineProfile& lineProfile =
+      m_lineProfile[LineKey(filename, functionName, line)];
+    lineProfile.instructions += count;
+
+    if (auto load = llvm::dyn_cast<llvm::LoadInst>(instruction))
+    {
+      lineProfile.memoryBytes += count * getTypeSize(load->getType());
+    }
+    else if (auto store = llvm::dyn_cast<llvm::StoreInst>(instruction))
+    {
+      const llvm::Type* type = store->getValueOperand()->getType();
+      lineProfile.memoryBytes += count * getTypeSize(type);
+    }
+    else if (auto call = llvm::dyn_cast<llvm::CallInst>(instruction))
+    {
+      const llvm::Function* callee = call->getCalledFunction();
+      if (callee && callee->isDeclaration() && !callee->isIntrinsic())
+        lineProfile.builtinCalls += count;
+    }
+  }
+}
+
+void InstructionCounter::writeCallgrindProfile(ostream& stream) const
+{
+  stream << "# callgrind format" << endl
+         << "version: 1" << endl
+         << "creator: Oclgrind " PACKAGE_VERSION << endl
+         << "positions: line" << endl
+         << "event: Ir : Instructions executed" << endl
+         << "event: Bytes : Bytes loaded and stored" << endl
+         << "event: Builtins : Builtin function calls" << endl
+         << "events: Ir Bytes Builtins" << endl;
+
+  // Costs are grouped by file and then by function
+  LineProfile totals = {0, 0, 0};
+  const string* file = NULL;
+  const string* function = NULL;
+  for (auto& itr : m_lineProfile)
+  {
+    const string& lineFile = get<0>(itr.first);
+    const string& lineFunction = get<1>(itr.first);
+    if (!file || *file != lineFile)
+    {
+      stream << endl << "fl=" << lineFile << endl;
+      file = &lineFile;
+      function = NULL;
+    }
+    if (!function || *function != lineFunction)
+    {
+      stream << "fn=" << lineFunction << endl;
+      function = &lineFunction;
+    }
+
+    const LineProfile& profile = itr.second;
+    stream << get<2>(itr.first) << " " << profile.instructions << " "
+           << profile.memoryBytes << " " << profile.builtinCalls << endl;
+
+    totals.instructions += profile.instructions;
+    totals.memoryBytes += profile.memoryBytes;
+    totals.builtinCalls += profile.builtinCalls;
+  }
+
+  stream << endl
+         << "totals: " << totals.instructions << " " << totals.memoryBytes
+         << " " << totals.builtinCalls << endl;
+}
+
+// Escape a string for use in a JSON document
+static string escapeJSON(const string& str)
+{
+  ostringstream escaped;
+  for (char c : str)
+  {
+    if (c == '"' || c == '\\')
+      escaped << '\\' << c;
+    else if ((unsigned char)c < 0x20)
+      escaped << "\\u" << hex << setw(4) << setfill('0') << (int)c << dec;
+    else
+      escaped << c;
+  }
+  return escaped.str();
+}
+
+void InstructionCounter::writeJSONProfile(ostream& stream) const
+{
+  stream << "{" << endl << "  \"lines\": [";
+  bool first = true;
+  for (auto& itr : m_lineProfile)
+  {
+    stream << (first ? "" : ",") << endl
+           << "    {\"file\": \"" << escapeJSON(get<0>(itr.first))
+           << "\", \"function\": \"" << escapeJSON(get<1>(itr.first))
+           << "\", \"line\": " << get<2>(itr.first)
+           << ", \"instructions\": " << itr.second.instructions
+           << ", \"memoryBytes\": " << itr.second.memoryBytes
+           << ", \"builtinCalls\": " << itr.second.builtinCalls << "}";
+    first = false;
+  }
+  stream << endl << "  ]," << endl << "  \"blocks\": [";
+  first = true;
+  for (auto& itr : m_blockProfile)
+  {
+    stream << (first ? "" : ",") << endl
+           << "    {\"function\": \"" << escapeJSON(itr.first.first)
+           << "\", \"block\": " << itr.first.second << ", \"name\": \""
+           << escapeJSON(itr.second.name)
+           << "\", \"line\": " << itr.second.line
+           << ", \"executions\": " << itr.second.executions
+           << ", \"instructions\": " << itr.second.instructions << "}";
+    first = false;
+  }
+  stream << endl << "  ]" << endl << "}" << endl;
+}
+
+void InstructionCounter::writeProfile() const
+{
+  // Rewrite the whole profile, so that it is complete after every kernel
+  ofstream stream(m_profileFile);
+  if (!stream.good())
+  {
+    cerr << "Oclgrind: Unable to open profile file '" << m_profileFile << "'"
+         << endl;
+    return;
+  }
+
+  if (m_profileFormat == JSON)
+    writeJSONProfile(stream);
+  else
+    writeCallgrindProfile(stream);
+}
+
+void InstructionCounter::writeStats(const KernelInvocation* kernelInvocation)
+{
+  double wallTime = chrono::duration<double>(chrono::steady_clock::now() -
+                                             m_kernelStartTime)
+                      .count();
+
+  // Combine loads, stores and calls of the same kind into the mix
+  map<string, size_t> mix;
+  size_t instructions = 0;
+  for (unsigned i = 0; i < m_instructionCounts.size(); i++)
+  {
+    if (m_instructionCounts[i] == 0)
+      continue;
+
+    string name;
+    if (i >= COUNTED_CALL_BASE)
+    {
+      name = m_functions[i - COUNTED_CALL_BASE]->getName().str();
+      if (name.compare(0, 9, "llvm.dbg.") == 0)
+        continue;
+      name = "call " + name;
+    }
+    else if (i >= COUNTED_STORE_BASE)
+      name = "store";
+    else if (i >= COUNTED_LOAD_BASE)
+      name = "load";
+    else
+      name = llvm::Instruction::getOpcodeName(i);
+
+    mix[name] += m_instructionCounts[i];
+    instructions += m_instructionCounts[i];
+  }
+  double rate = wallTime > 0 ? instructions / wallTime : 0;
+
+  const string& kernelName = kernelInvocation->getKernel()->getName();
+  Size3 globalSize = kernelInvocation->getGlobalSize();
+  Size3 localSize = kernelInvocation->getLocalSize();
+  Size3 globalOffset = kernelInvocation->getGlobalOffset();
+
+  // Format the record before writing it, so that records from other
+  // contexts are not interleaved with it
+  ostringstream record;
+  if (m_statsFormat == STATS_CSV)
+  {
+    record << kernelName << "," << kernelInvocation->getWorkDim() << ","
+           << globalSize.x << "x" << globalSize.y << "x"
+           << globalSize.z << "," << localSize.x << "x" << localSize.y
+           << "x" << localSize.z << "," << globalOffset.x << "x"
+           << globalOffset.y << "x" << globalOffset.z << ","
+           << instructions;
+    for (unsigned addrSpace = 0; addrSpace < 4; addrSpace++)
+    {
+      record << "," << m_memopBytes[addrSpace] << ","
+             << m_memopBytes[8 + addrSpace];
+    }
+    record << "," << m_atomics << "," << m_barriers << "," << wallTime
+           << "," << rate << ",\"";
+    bool first = true;
+    for (auto& itr : mix)
+    {
+      record << (first ? "" : ";") << itr.first << "=" << itr.second;
+      first = false;
+    }
+    record << "\"" << endl;
+  }
+  else
+  {
+    // Each record is a single line, so that the file can be read as JSON
+    // Lines
+    record << "{\"kernel\": \"" << escapeJSON(kernelName)
+           << "\", \"workDim\": " << kernelInvocation->getWorkDim()
+           << ", \"globalSize\": [" << globalSize.x << ", "
+           << globalSize.y << ", " << globalSize.z
+           << "], \"localSize\": [" << localSize.x << ", "
+           << localSize.y << ", " << localSize.z
+           << "], \"globalOffset\": [" << globalOffset.x << ", "
+           << globalOffset.y << ", " << globalOffset.z
+           << "], \"instructions\": " << instructions
+           << ", \"instructionMix\": {";
+    bool first = true;
+    for (auto& itr : mix)
+    {
+      record << (first ? "" : ", ") << "\"" << escapeJSON(itr.first)
+             << "\": " << itr.second;
+      first = false;
+    }
+    record << "}, \"memoryBytes\": {";
+    for (unsigned addrSpace = 0; addrSpace < 4; addrSpace++)
+    {
+      record << (addrSpace ? ", " : "") << "\""
+             << getAddressSpaceName(addrSpace) << "\": {\"load\": "
+             << m_memopBytes[addrSpace]
+             << ", \"store\": " << m_memopBytes[8 + addrSpace] << "}";
+    }
+    record << "}, \"atomics\": " << m_atomics
+           << ", \"barriers\": " << m_barriers
+           << ", \"wallTime\": " << wallTime
+           << ", \"instructionsPerSecond\": " << rate << "}" << endl;
+  }
+
+  lock_guard<mutex> lock(m_statsMutex);
+  m_statsStream << record.str() << flush;
 }
@@ -8,7 +8,10 @@
 
 #include "core/Plugin.h"
 
+#include <chrono>
+#include <fstream>
 #include <mutex>
+#include <tuple>
 
 namespace llvm
 {
@@ -20,31 +23,100 @@ namespace oclgrind
 class InstructionCounter : public Plugin
 {
 public:
-  InstructionCounter(const Context* context) : Plugin(context){};
+  InstructionCounter(const Context* context);
 
   virtual void instructionExecuted(const WorkItem* workItem,
                                    const llvm::Instruction* instruction,
                                    const TypedValue& result) override;
   virtual void kernelBegin(const KernelInvocation* kernelInvocation) override;
   virtual void kernelEnd(const KernelInvocation* kernelInvocation) override;
+  virtual void memoryAtomicLoad(const Memory* memory, const WorkItem* workItem,
+                                AtomicOp op, size_t address,
+                                size_t size) override;
+  virtual void workGroupBarrier(const WorkGroup* workGroup,
+                                uint32_t flags) override;
   virtual void workGroupBegin(const WorkGroup* workGroup) override;
   virtual void workGroupComplete(const WorkGroup* workGroup) override;
 
+  virtual Subscription getSubscribedEvents() const override;
+
 private:
+  bool m_printCounts;
   std::vector<size_t> m_instructionCounts;
   std::vector<size_t> m_memopBytes;
   std::vector<const llvm::Function*> m_functions;
 
+  // Execution counts indexed by position in the kernel's instruction stream
+  std::vector<size_t> m_profileCounts;
+
   struct WorkerState
   {
     std::vector<size_t>* instCounts;
     std::vector<size_t>* memopBytes;
     std::vector<const llvm::Function*>* functions;
+    std::vector<size_t>* profileCounts;
+    size_t atomics;
+    size_t barriers;
   };
   static THREAD_LOCAL WorkerState m_state;
 
   std::mutex m_mtx;
 
+  // Source-line and basic-block profile, accumulated across the kernels of
+  // every context in the process
+  enum ProfileFormat
+  {
+    CALLGRIND,
+    JSON
+  };
+  struct LineProfile
+  {
+    size_t instructions;
+    size_t memoryBytes;
+    size_t builtinCalls;
+  };
+  struct BlockProfile
+  {
+    std::string name;
+    unsigned line;
+    size_t executions;
+    size_t instructions;
+  };
+  // Keyed by (file, function, line) and (function, block index)
+  typedef std::tuple<std::string, std::string, unsigned> LineKey;
+  typedef std::pair<std::string, unsigned> BlockKey;
+
+  const char* m_profileFile;
+  ProfileFormat m_profileFormat;
+  static std::mutex m_profileMutex;
+  static std::map<LineKey, LineProfile> m_lineProfile;
+  static std::map<BlockKey, BlockProfile> m_blockProfile;
+
+  // Per-invocation statistics, written as one record per kernel
+  enum StatsFormat
+  {
+    STATS_CSV,
+    STATS_JSON
+  };
+
+  const char* m_statsFile;
+  StatsFormat m_statsFormat;
+  size_t m_atomics;
+  size_t m_barriers;
+  std::chrono::steady_clock::time_point m_kernelStartTime;
+
+  // The statistics file is shared by every context in the process, so that
+  // it is only opened (and truncated) once
+  static std::mutex m_statsMutex;
+  static std::ofstream m_statsStream;
+  static bool m_statsOpened;
+
   std::string getOpcodeName(unsigned opcode) const;
+  void printCounts(const KernelInvocation* kernelInvocation) const;
+  void updateProfile(const KernelInvocation* kernelInvocation);
+  void writeCallgrindProfile(std::ostream& stream) const;
+  void writeJSONProfile(std::ostream& stream) const;
+  void writeProfile() const;
+  void writeStats(const KernelInvocation* kernelInvocation);
 };
 } // namespace oclgrind
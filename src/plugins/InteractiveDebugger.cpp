@@ -183,6 +183,12 @@ void InteractiveDebugger::instructionExecuted(
   }
 }
 
+Plugin::Subscription InteractiveDebugger::getSubscribedEvents() const
+{
+  return (1 << INSTRUCTION_EXECUTED) | (1 << KERNEL_BEGIN) | (1 << KERNEL_END) |
+         (1 << LOG);
+}
+
 bool InteractiveDebugger::isThreadSafe() const
 {
   return false;
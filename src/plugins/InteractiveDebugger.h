@@ -24,6 +24,7 @@ public:
   virtual void kernelEnd(const KernelInvocation* kernelInvocation) override;
   virtual void log(MessageType type, const char* message) override;
 
+  virtual Subscription getSubscribedEvents() const override;
   virtual bool isThreadSafe() const override;
 
 private:
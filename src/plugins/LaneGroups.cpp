@@ -0,0 +1,65 @@
+// LaneGroups.cpp (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#include "core/common.h"
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Instruction.h"
+
+#include "LaneGroups.h"
+
+#include "core/WorkGroup.h"
+#include "core/WorkItem.h"
+
+using namespace oclgrind;
+using namespace std;
+
+SourceLine oclgrind::getSourceLine(const llvm::Instruction* instruction)
+{
+  if (const llvm::DILocation* loc = instruction->getDebugLoc().get())
+    return SourceLine(loc->getFilename().str(), loc->getLine());
+  return SourceLine("???", 0);
+}
+
+LaneGroupMatcher::LaneGroupMatcher(unsigned simdWidth)
+{
+  m_simdWidth = simdWidth;
+  m_numLanes = 0;
+}
+
+size_t LaneGroupMatcher::getLane(const WorkItem* workItem) const
+{
+  Size3 lid = workItem->getLocalID();
+  Size3 groupSize = workItem->getWorkGroup()->getGroupSize();
+  return lid.x + (lid.y + lid.z * groupSize.y) * groupSize.x;
+}
+
+size_t LaneGroupMatcher::match(const WorkItem* workItem,
+                               const llvm::Instruction* instruction,
+                               size_t numInstances)
+{
+  size_t lane = getLane(workItem);
+
+  // Work-items within a lane group are matched up by how many times each of
+  // them has already executed this instruction
+  vector<unsigned>& occurrences = m_occurrences[instruction];
+  if (occurrences.empty())
+    occurrences.resize(m_numLanes);
+  unsigned occurrence = occurrences[lane]++;
+
+  InstanceKey key(instruction, lane / m_simdWidth, occurrence);
+  return m_indices.insert(make_pair(key, numInstances)).first->second;
+}
+
+void LaneGroupMatcher::reset(const WorkGroup* workGroup)
+{
+  Size3 groupSize = workGroup->getGroupSize();
+  m_numLanes = groupSize.x * groupSize.y * groupSize.z;
+  m_indices.clear();
+  m_occurrences.clear();
+}
@@ -0,0 +1,130 @@
+// LaneGroups.h (Oclgrind)
+// Copyright (c) 2013-2019, James Price and Simon McIntosh-Smith,
+// University of Bristol. All rights reserved.
+//
+// This program is provided under a three-clause BSD license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#pragma once
+
+#include "core/common.h"
+
+#include <algorithm>
+#include <functional>
+#include <tuple>
+
+namespace oclgrind
+{
+class WorkGroup;
+class WorkItem;
+
+// Source location of an instruction, as (file, line)
+typedef std::pair<std::string, unsigned> SourceLine;
+SourceLine getSourceLine(const llvm::Instruction* instruction);
+
+// Matches up the dynamic instances of each instruction executed by the
+// work-items of a SIMD lane group, within a single work-group
+class LaneGroupMatcher
+{
+public:
+  LaneGroupMatcher(unsigned simdWidth);
+
+  // Linear index of a work-item within its work-group
+  size_t getLane(const WorkItem* workItem) const;
+
+  // Start matching instructions executed by a new work-group
+  void reset(const WorkGroup* workGroup);
+
+protected:
+  // Return the index of the instance that the work-item's next execution
+  // of an instruction belongs to, or numInstances if it starts a new one
+  size_t match(const WorkItem* workItem, const llvm::Instruction* instruction,
+               size_t numInstances);
+
+private:
+  unsigned m_simdWidth;
+  size_t m_numLanes;
+
+  // Keyed by (instruction, lane group, per-work-item occurrence)
+  typedef std::tuple<const llvm::Instruction*, size_t, unsigned> InstanceKey;
+  std::map<InstanceKey, size_t> m_indices;
+  std::map<const llvm::Instruction*, std::vector<unsigned>> m_occurrences;
+};
+
+// Instances of instructions executed by SIMD lane groups, in the order in
+// which they were first reached. Instance must be default constructible
+// with an 'instruction' member.
+template <typename Instance> class LaneGroupInstances : public LaneGroupMatcher
+{
+public:
+  LaneGroupInstances(unsigned simdWidth) : LaneGroupMatcher(simdWidth) {}
+
+  Instance& get(const WorkItem* workItem,
+                const llvm::Instruction* instruction)
+  {
+    size_t index = match(workItem, instruction, m_instances.size());
+    if (index == m_instances.size())
+    {
+      m_instances.push_back(Instance());
+      m_instances.back().instruction = instruction;
+    }
+    return m_instances[index];
+  }
+
+  std::vector<Instance>& getInstances()
+  {
+    return m_instances;
+  }
+
+  void reset(const WorkGroup* workGroup)
+  {
+    LaneGroupMatcher::reset(workGroup);
+    m_instances.clear();
+  }
+
+private:
+  std::vector<Instance> m_instances;
+};
+
+// Merge per-instruction statistics into the statistics of their source
+// lines. Stats must provide operator+=.
+template <typename Stats>
+void mergeLineStats(
+  std::map<SourceLine, Stats>& lineStats,
+  const std::map<const llvm::Instruction*, Stats>& instructionStats)
+{
+  for (auto& itr : instructionStats)
+    lineStats[getSourceLine(itr.first)] += itr.second;
+}
+
+// Print a row of statistics for each source line to stdout, in descending
+// order of the sort key, followed by their total
+template <typename Stats>
+void printLineStats(const std::map<SourceLine, Stats>& lineStats,
+                    std::function<size_t(const Stats&)> sortKey,
+                    std::function<void(const Stats&)> printRow)
+{
+  std::vector<std::pair<SourceLine, Stats>> lines(lineStats.begin(),
+                                                  lineStats.end());
+  std::stable_sort(lines.begin(), lines.end(),
+                   [&](const std::pair<SourceLine, Stats>& a,
+                       const std::pair<SourceLine, Stats>& b) {
+                     return sortKey(a.second) > sortKey(b.second);
+                   });
+
+  Stats totals = Stats();
+  for (auto& line : lines)
+    totals += line.second;
+  lines.push_back(make_pair(SourceLine("Total", 0), totals));
+
+  for (auto& line : lines)
+  {
+    printRow(line.second);
+    std::cout << "  " << line.first.first;
+    if (line.first.second)
+      std::cout << ":" << line.first.second;
+    std::cout << std::endl;
+  }
+}
+} // namespace oclgrind
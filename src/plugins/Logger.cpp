@@ -69,3 +69,8 @@ void Logger::log(MessageType type, const char* message)
 
   *m_log << endl << message << endl;
 }
+
+Plugin::Subscription Logger::getSubscribedEvents() const
+{
+  return (1 << LOG);
+}
@@ -18,6 +18,8 @@ public:
 
   virtual void log(MessageType type, const char* message) override;
 
+  virtual Subscription getSubscribedEvents() const override;
+
 private:
   std::ostream* m_log;
 
@@ -9,10 +9,15 @@
 #include "core/common.h"
 
 #include "core/Context.h"
+#include "core/Kernel.h"
+#include "core/KernelInvocation.h"
 #include "core/Memory.h"
+#include "core/Program.h"
 #include "core/WorkItem.h"
 
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 
 #include "MemCheck.h"
@@ -20,38 +25,61 @@
 using namespace oclgrind;
 using namespace std;
 
-MemCheck::MemCheck(const Context* context) : Plugin(context) {}
+MemCheck::MemCheck(const Context* context) : Plugin(context)
+{
+  m_reportArrayChecks = checkEnv("OCLGRIND_ARRAY_CHECKS");
+}
 
-void MemCheck::instructionExecuted(const WorkItem* workItem,
-                                   const llvm::Instruction* instruction,
-                                   const TypedValue& result)
+void MemCheck::kernelBegin(const KernelInvocation* kernelInvocation)
 {
-  // Check static array bounds if load or store is executed
-  const llvm::Value* PtrOp = nullptr;
+  // Address identifying the array checks among the analyses of a kernel
+  static const char arrayChecksKey = 0;
 
-  if (auto LI = llvm::dyn_cast<llvm::LoadInst>(instruction))
-  {
-    PtrOp = LI->getPointerOperand();
-  }
-  else if (auto SI = llvm::dyn_cast<llvm::StoreInst>(instruction))
-  {
-    PtrOp = SI->getPointerOperand();
-  }
-  else
+  const Kernel* kernel = kernelInvocation->getKernel();
+  const InterpreterCache* cache =
+    kernel->getProgram()->getInterpreterCache(kernel->getFunction());
+
+  m_arrayChecks = static_pointer_cast<const KernelArrayChecks>(
+    cache->getAnalysis(&arrayChecksKey));
+  if (!m_arrayChecks)
   {
-    return;
+    // Find the static array accesses of each load and store that the
+    // kernel can execute, so that they can be checked when the memory
+    // access is performed
+    shared_ptr<KernelArrayChecks> arrayChecks =
+      make_shared<KernelArrayChecks>();
+    arrayChecks->numProven = 0;
+    for (unsigned i = 0; i < cache->getNumInstructions(); i++)
+    {
+      addArrayChecks(cache, cache->getInstruction(i).instruction,
+                     *arrayChecks);
+    }
+
+    cache->setAnalysis(&arrayChecksKey, arrayChecks);
+    m_arrayChecks = arrayChecks;
   }
 
-  // Walk up chain of GEP instructions leading to this access
-  while (auto GEPI =
-           llvm::dyn_cast<llvm::GetElementPtrInst>(PtrOp->stripPointerCasts()))
+  if (m_reportArrayChecks)
   {
-    checkArrayAccess(workItem, GEPI);
+    size_t numChecked = 0;
+    for (auto& checks : m_arrayChecks->checks)
+    {
+      numChecked += checks.second.size();
+    }
 
-    PtrOp = GEPI->getPointerOperand();
+    Context::Message msg(INFO, m_context);
+    msg << "Static array indices in kernel '" << kernel->getName()
+        << "': " << numChecked << " checked during execution, "
+        << m_arrayChecks->numProven << " proven in range";
+    msg.send();
   }
 }
 
+void MemCheck::kernelEnd(const KernelInvocation* kernelInvocation)
+{
+  m_arrayChecks.reset();
+}
+
 void MemCheck::memoryAtomicLoad(const Memory* memory, const WorkItem* workItem,
                                 AtomicOp op, size_t address, size_t size)
 {
@@ -68,6 +96,7 @@ void MemCheck::memoryLoad(const Memory* memory, const WorkItem* workItem,
                           size_t address, size_t size)
 {
   checkLoad(memory, address, size);
+  checkArrayAccess(workItem);
 }
 
 void MemCheck::memoryLoad(const Memory* memory, const WorkGroup* workGroup,
@@ -89,6 +118,7 @@ void MemCheck::memoryStore(const Memory* memory, const WorkItem* workItem,
                            const uint8_t* storeData)
 {
   checkStore(memory, address, size);
+  checkArrayAccess(workItem);
 }
 
 void MemCheck::memoryStore(const Memory* memory, const WorkGroup* workGroup,
@@ -112,43 +142,160 @@ void MemCheck::memoryUnmap(const Memory* memory, size_t address,
   }
 }
 
-void MemCheck::checkArrayAccess(const WorkItem* workItem,
-                                const llvm::GetElementPtrInst* GEPI) const
+Plugin::Subscription MemCheck::getSubscribedEvents() const
 {
-  // Iterate through GEPI indices
-  const llvm::Type* ptrType = GEPI->getPointerOperandType();
+  return (1 << KERNEL_BEGIN) | (1 << KERNEL_END) | (1 << MEMORY_ATOMIC_LOAD) |
+         (1 << MEMORY_ATOMIC_STORE) | (1 << MEMORY_LOAD) | (1 << MEMORY_MAP) |
+         (1 << MEMORY_STORE) | (1 << MEMORY_UNMAP);
+}
 
-  for (auto opIndex = GEPI->idx_begin(); opIndex != GEPI->idx_end(); opIndex++)
+// Returns true if a value is masked with a non-negative constant that is
+// smaller than size
+static bool isMaskedBelow(const llvm::Value* value, uint64_t size)
+{
+  auto BO = llvm::dyn_cast<llvm::BinaryOperator>(value);
+  if (!BO || BO->getOpcode() != llvm::Instruction::And)
   {
-    int64_t index = workItem->getOperand(opIndex->get()).getSInt();
+    return false;
+  }
 
-    if (ptrType->isArrayTy())
+  for (unsigned i = 0; i < 2; i++)
+  {
+    auto mask = llvm::dyn_cast<llvm::ConstantInt>(BO->getOperand(i));
+    if (mask && !mask->isNegative() && (uint64_t)mask->getSExtValue() < size)
     {
-      // Check index doesn't exceed size of array
-      uint64_t size = ptrType->getArrayNumElements();
-
-      if ((uint64_t)index >= size)
-      {
-        ostringstream info;
-        info << "Index (" << index << ") exceeds static array size (" << size
-             << ")";
-        m_context->logError(info.str().c_str());
-      }
-
-      ptrType = ptrType->getArrayElementType();
+      return true;
     }
-    else if (ptrType->isPointerTy())
+  }
+  return false;
+}
+
+// Returns true if an array index is known to be in range before execution
+static bool isIndexInRange(const llvm::Value* index, uint64_t size)
+{
+  if (auto C = llvm::dyn_cast<llvm::ConstantInt>(index))
+  {
+    return (uint64_t)C->getSExtValue() < size;
+  }
+  else if (llvm::isa<llvm::SExtInst>(index) || llvm::isa<llvm::ZExtInst>(index))
+  {
+    // Extending a masked value (e.g. an int index) keeps it non-negative
+    auto CI = llvm::cast<llvm::CastInst>(index);
+    if (isMaskedBelow(CI->getOperand(0), size))
     {
-      assert(opIndex == GEPI->idx_begin());
-      ptrType = GEPI->getSourceElementType();
+      return true;
     }
-    else if (ptrType->isVectorTy())
+
+    // Zero-extended values are bounded by the width of the source type
+    unsigned bits = CI->getSrcTy()->getScalarSizeInBits();
+    return llvm::isa<llvm::ZExtInst>(CI) && bits < 64 && (1ULL << bits) <= size;
+  }
+  return isMaskedBelow(index, size);
+}
+
+void MemCheck::addArrayChecks(const InterpreterCache* cache,
+                              const llvm::Instruction* instruction,
+                              KernelArrayChecks& arrayChecks) const
+{
+  const llvm::Value* PtrOp = nullptr;
+
+  if (auto LI = llvm::dyn_cast<llvm::LoadInst>(instruction))
+  {
+    PtrOp = LI->getPointerOperand();
+  }
+  else if (auto SI = llvm::dyn_cast<llvm::StoreInst>(instruction))
+  {
+    PtrOp = SI->getPointerOperand();
+  }
+  else
+  {
+    return;
+  }
+
+  vector<ArrayCheck> checks;
+
+  // Walk up chain of GEP instructions leading to this access
+  while (auto GEPI =
+           llvm::dyn_cast<llvm::GetElementPtrInst>(PtrOp->stripPointerCasts()))
+  {
+    // Iterate through GEPI indices
+    const llvm::Type* ptrType = GEPI->getPointerOperandType();
+
+    for (auto opIndex = GEPI->idx_begin(); opIndex != GEPI->idx_end();
+         opIndex++)
     {
-      ptrType = llvm::cast<llvm::FixedVectorType>(ptrType)->getElementType();
+      if (ptrType->isArrayTy())
+      {
+        // Index needs checking unless it is provably in range
+        uint64_t size = ptrType->getArrayNumElements();
+        if (!isIndexInRange(opIndex->get(), size))
+        {
+          ArrayCheck check = {cache->resolveOperand(opIndex->get()), size};
+          checks.push_back(check);
+        }
+        else if (!llvm::isa<llvm::Constant>(opIndex->get()))
+        {
+          arrayChecks.numProven++;
+        }
+
+        ptrType = ptrType->getArrayElementType();
+      }
+      else if (ptrType->isPointerTy())
+      {
+        assert(opIndex == GEPI->idx_begin());
+        ptrType = GEPI->getSourceElementType();
+      }
+      else if (ptrType->isVectorTy())
+      {
+        ptrType = llvm::cast<llvm::FixedVectorType>(ptrType)->getElementType();
+      }
+      else if (ptrType->isStructTy())
+      {
+        // Struct member indices are always constant
+        auto index = llvm::dyn_cast<llvm::ConstantInt>(opIndex->get());
+        if (!index)
+        {
+          break;
+        }
+        ptrType = ptrType->getStructElementType(index->getZExtValue());
+      }
     }
-    else if (ptrType->isStructTy())
+
+    PtrOp = GEPI->getPointerOperand();
+  }
+
+  if (!checks.empty())
+  {
+    arrayChecks.checks[instruction] = checks;
+  }
+}
+
+void MemCheck::checkArrayAccess(const WorkItem* workItem) const
+{
+  if (!m_arrayChecks || m_arrayChecks->checks.empty())
+  {
+    return;
+  }
+
+  // Check static array bounds of the load or store being executed
+  ArrayCheckMap::const_iterator checks =
+    m_arrayChecks->checks.find(workItem->getCurrentInstruction());
+  if (checks == m_arrayChecks->checks.end())
+  {
+    return;
+  }
+
+  for (const ArrayCheck& check : checks->second)
+  {
+    int64_t index = workItem->getOperand(check.index).getSInt();
+
+    // Check index doesn't exceed size of array
+    if ((uint64_t)index >= check.size)
     {
-      ptrType = ptrType->getStructElementType(index);
+      ostringstream info;
+      info << "Index (" << index << ") exceeds static array size ("
+           << check.size << ")";
+      m_context->logError(info.str().c_str());
     }
   }
 }
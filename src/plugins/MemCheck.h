@@ -7,11 +7,7 @@
 // source code.
 
 #include "core/Plugin.h"
-
-namespace llvm
-{
-class GetElementPtrInst;
-}
+#include "core/WorkItem.h"
 
 namespace oclgrind
 {
@@ -20,9 +16,8 @@ class MemCheck : public Plugin
 public:
   MemCheck(const Context* context);
 
-  virtual void instructionExecuted(const WorkItem* workItem,
-                                   const llvm::Instruction* instruction,
-                                   const TypedValue& result) override;
+  virtual void kernelBegin(const KernelInvocation* kernelInvocation) override;
+  virtual void kernelEnd(const KernelInvocation* kernelInvocation) override;
   virtual void memoryAtomicLoad(const Memory* memory, const WorkItem* workItem,
                                 AtomicOp op, size_t address,
                                 size_t size) override;
@@ -44,9 +39,14 @@ public:
   virtual void memoryUnmap(const Memory* memory, size_t address,
                            const void* ptr) override;
 
+  virtual Subscription getSubscribedEvents() const override;
+
 private:
-  void checkArrayAccess(const WorkItem* workItem,
-                        const llvm::GetElementPtrInst* GEPI) const;
+  struct KernelArrayChecks;
+  void addArrayChecks(const InterpreterCache* cache,
+                      const llvm::Instruction* instruction,
+                      KernelArrayChecks& arrayChecks) const;
+  void checkArrayAccess(const WorkItem* workItem) const;
   void checkLoad(const Memory* memory, size_t address, size_t size) const;
   void checkStore(const Memory* memory, size_t address, size_t size) const;
   void logInvalidAccess(bool read, unsigned addrSpace, size_t address,
@@ -65,5 +65,26 @@ private:
     } type;
   };
   std::list<MapRegion> m_mapRegions;
+
+  // Static array indices that loads and stores depend on, which cannot be
+  // proven to be in range before the kernel runs
+  struct ArrayCheck
+  {
+    InterpreterCache::Operand index;
+    uint64_t size;
+  };
+  typedef std::unordered_map<const llvm::Instruction*, std::vector<ArrayCheck>>
+    ArrayCheckMap;
+
+  // Array checks for the functions that each kernel can call, which are
+  // only found the first time the kernel is enqueued (and are kept in the
+  // kernel's interpreter cache, so they are released with its program)
+  struct KernelArrayChecks
+  {
+    ArrayCheckMap checks;
+    size_t numProven; // Non-constant indices proven to be in range
+  };
+  std::shared_ptr<const KernelArrayChecks> m_arrayChecks;
+  bool m_reportArrayChecks;
 };
 } // namespace oclgrind
@@ -8,9 +8,13 @@
 
 #include "core/common.h"
 
+#include <algorithm>
+
 #include "core/Context.h"
+#include "core/Kernel.h"
 #include "core/KernelInvocation.h"
 #include "core/Memory.h"
+#include "core/Program.h"
 #include "core/WorkGroup.h"
 #include "core/WorkItem.h"
 
@@ -21,23 +25,40 @@ using namespace std;
 
 THREAD_LOCAL RaceDetector::WorkerState RaceDetector::m_state = {NULL};
 
-#define STATE(workgroup) (m_state.groups->at(workgroup))
+#define STATE(workgroup) (*m_state.groups->at(workgroup))
 
-// Use a bank of mutexes to reduce unnecessary synchronisation
+// Use a bank of mutexes (indexed by shadow page) to reduce unnecessary
+// synchronisation
 #define NUM_GLOBAL_MUTEXES 4096 // Must be power of two
-#define GLOBAL_MUTEX(buffer, offset)                                           \
-  m_globalMutexes[buffer][offset & (NUM_GLOBAL_MUTEXES - 1)]
+#define GLOBAL_MUTEX(buffer, page)                                             \
+  m_globalMutexes[buffer][page & (NUM_GLOBAL_MUTEXES - 1)]
 
 RaceDetector::RaceDetector(const Context* context) : Plugin(context)
 {
   m_kernelInvocation = NULL;
+  m_cache = NULL;
 
   m_allowUniformWrites = !checkEnv("OCLGRIND_UNIFORM_WRITES");
 }
 
+RaceDetector::~RaceDetector()
+{
+  for (auto& buffer : m_globalAccesses)
+  {
+    for (ShadowPage* page : buffer.second)
+      delete page;
+  }
+
+  for (WorkGroupState* state : m_freeStates)
+    delete state;
+}
+
 void RaceDetector::kernelBegin(const KernelInvocation* kernelInvocation)
 {
   m_kernelInvocation = kernelInvocation;
+
+  const Kernel* kernel = kernelInvocation->getKernel();
+  m_cache = kernel->getProgram()->getInterpreterCache(kernel->getFunction());
 }
 
 void RaceDetector::kernelEnd(const KernelInvocation* kernelInvocation)
@@ -47,15 +68,20 @@ void RaceDetector::kernelEnd(const KernelInvocation* kernelInvocation)
     logRace(race);
   kernelRaces.clear();
 
-  // Clear all global memory accesses
-  for (auto& buffer : m_globalAccesses)
+  // Release shadow pages for global memory accessed by this kernel
+  for (auto& dirty : m_dirtyPages)
   {
-    size_t sz = buffer.second.size();
-    buffer.second.clear();
-    buffer.second.resize(sz);
+    auto buffer = m_globalAccesses.find(dirty.first);
+    if (buffer != m_globalAccesses.end())
+    {
+      delete buffer->second[dirty.second];
+      buffer->second[dirty.second] = NULL;
+    }
   }
+  m_dirtyPages.clear();
 
   m_kernelInvocation = NULL;
+  m_cache = NULL;
 }
 
 void RaceDetector::memoryAllocated(const Memory* memory, size_t address,
@@ -65,7 +91,8 @@ void RaceDetector::memoryAllocated(const Memory* memory, size_t address,
   size_t buffer = memory->extractBuffer(address);
   if (memory->getAddressSpace() == AddrSpaceGlobal)
   {
-    m_globalAccesses[buffer].resize(size);
+    m_globalAccesses[buffer].resize(
+      (size + SHADOW_PAGE_SIZE - 1) / SHADOW_PAGE_SIZE, NULL);
     m_globalMutexes[buffer] = new mutex[NUM_GLOBAL_MUTEXES];
   }
 }
@@ -91,6 +118,8 @@ void RaceDetector::memoryDeallocated(const Memory* memory, size_t address)
   size_t buffer = memory->extractBuffer(address);
   if (memory->getAddressSpace() == AddrSpaceGlobal)
   {
+    for (ShadowPage* page : m_globalAccesses.at(buffer))
+      delete page;
     m_globalAccesses.erase(buffer);
 
     delete[] m_globalMutexes.at(buffer);
@@ -145,19 +174,31 @@ void RaceDetector::workGroupBegin(const WorkGroup* workGroup)
   // Create worker state if haven't already
   if (!m_state.groups)
   {
-    m_state.groups = new unordered_map<const WorkGroup*, WorkGroupState>;
+    m_state.groups = new unordered_map<const WorkGroup*, WorkGroupState*>;
   }
 
+  // Re-use the state (and access maps) of a completed work-group
+  WorkGroupState* state = NULL;
+  {
+    lock_guard<mutex> lock(m_freeStatesMutex);
+    if (!m_freeStates.empty())
+    {
+      state = m_freeStates.back();
+      m_freeStates.pop_back();
+    }
+  }
+  if (!state)
+    state = new WorkGroupState;
+  (*m_state.groups)[workGroup] = state;
+
   // Initialize work-group state
-  WorkGroupState& state = (*m_state.groups)[workGroup];
   Size3 wgsize = workGroup->getGroupSize();
-  state.numWorkItems = wgsize.x * wgsize.y * wgsize.z;
-
-  // Re-use pool allocator for all access maps
-  AccessMap tmp(0, AccessMap::hasher(), AccessMap::key_equal(),
-                state.wgGlobal.get_allocator());
-  state.wiGlobal.resize(state.numWorkItems + 1, tmp);
-  state.wiLocal.resize(state.numWorkItems + 1, tmp);
+  state->numWorkItems = wgsize.x * wgsize.y * wgsize.z;
+  if (state->wiGlobal.size() < state->numWorkItems + 1)
+  {
+    state->wiGlobal.resize(state->numWorkItems + 1);
+    state->wiLocal.resize(state->numWorkItems + 1);
+  }
 }
 
 void RaceDetector::workGroupComplete(const WorkGroup* workGroup)
@@ -167,36 +208,37 @@ void RaceDetector::workGroupComplete(const WorkGroup* workGroup)
   syncWorkItems(workGroup->getLocalMemory(), state, state.wiLocal);
   syncWorkItems(m_context->getGlobalMemory(), state, state.wiGlobal);
 
-  // Merge global accesses across kernel invocation
+  // Merge global accesses across kernel invocation, in batches that cover
+  // a single shadow page (sorting by address ensures these are contiguous)
+  const Memory* memory = m_context->getGlobalMemory();
   size_t group = workGroup->getGroupIndex();
-  for (auto& record : state.wgGlobal)
+  state.wgGlobal.sort();
+  auto record = state.wgGlobal.begin();
+  while (record != state.wgGlobal.end())
   {
-    size_t address = record.first;
-    size_t buffer = m_context->getGlobalMemory()->extractBuffer(address);
-    size_t offset = m_context->getGlobalMemory()->extractOffset(address);
-
-    lock_guard<mutex> lock(GLOBAL_MUTEX(buffer, offset));
+    size_t buffer = memory->extractBuffer(record->first);
+    size_t pageIndex = memory->extractOffset(record->first) / SHADOW_PAGE_SIZE;
 
-    AccessRecord& a = record.second;
-    AccessRecord& b = m_globalAccesses.at(buffer)[offset];
-
-    // Check for races with previous accesses
-    if (check(a.load, b.store) && getAccessWorkGroup(b.store) != group)
-      insertKernelRace({AddrSpaceGlobal, address, a.load, b.store});
-    if (check(a.store, b.load) && getAccessWorkGroup(b.load) != group)
-      insertKernelRace({AddrSpaceGlobal, address, a.store, b.load});
-    if (check(a.store, b.store) && getAccessWorkGroup(b.store) != group)
-      insertKernelRace({AddrSpaceGlobal, address, a.store, b.store});
-
-    // Insert accesses
-    if (a.load.isSet())
-      insert(b, a.load);
-    if (a.store.isSet())
-      insert(b, a.store);
+    lock_guard<mutex> lock(GLOBAL_MUTEX(buffer, pageIndex));
+    ShadowPage* page = getShadowPage(buffer, pageIndex);
+    for (; record != state.wgGlobal.end(); record++)
+    {
+      size_t address = record->first;
+      size_t offset = memory->extractOffset(address);
+      if (memory->extractBuffer(address) != buffer ||
+          offset / SHADOW_PAGE_SIZE != pageIndex)
+        break;
+      mergeGlobalAccess(page, offset % SHADOW_PAGE_SIZE, address, group,
+                        record->second);
+    }
   }
   state.wgGlobal.clear();
 
-  // Clean-up work-group state
+  // Clean-up work-group state (all access maps are now empty)
+  {
+    lock_guard<mutex> lock(m_freeStatesMutex);
+    m_freeStates.push_back(&state);
+  }
   m_state.groups->erase(workGroup);
   if (m_state.groups->empty())
   {
@@ -205,6 +247,15 @@ void RaceDetector::workGroupComplete(const WorkGroup* workGroup)
   }
 }
 
+Plugin::Subscription RaceDetector::getSubscribedEvents() const
+{
+  return (1 << KERNEL_BEGIN) | (1 << KERNEL_END) | (1 << MEMORY_ALLOCATED) |
+         (1 << MEMORY_ATOMIC_LOAD) | (1 << MEMORY_ATOMIC_STORE) |
+         (1 << MEMORY_DEALLOCATED) | (1 << MEMORY_LOAD) | (1 << MEMORY_STORE) |
+         (1 << WORK_GROUP_BARRIER) | (1 << WORK_GROUP_BEGIN) |
+         (1 << WORK_GROUP_COMPLETE);
+}
+
 bool RaceDetector::check(const MemoryAccess& a, const MemoryAccess& b) const
 {
   // Ensure both accesses are valid
@@ -234,6 +285,29 @@ bool RaceDetector::check(const MemoryAccess& a, const MemoryAccess& b) const
   return false;
 }
 
+const llvm::Instruction*
+RaceDetector::getInstruction(const MemoryAccess& access) const
+{
+  if (!access.getInstruction())
+    return NULL;
+  return m_cache->getInstruction(access.getInstruction() - 1).instruction;
+}
+
+RaceDetector::ShadowPage* RaceDetector::getShadowPage(size_t buffer,
+                                                     size_t page)
+{
+  // Caller must hold the mutex for this page
+  ShadowPage*& shadow = m_globalAccesses.at(buffer)[page];
+  if (!shadow)
+  {
+    shadow = new ShadowPage;
+
+    lock_guard<mutex> lock(m_dirtyPagesMutex);
+    m_dirtyPages.push_back({buffer, page});
+  }
+  return shadow;
+}
+
 size_t RaceDetector::getAccessWorkGroup(const MemoryAccess& access) const
 {
   if (access.isWorkItem())
@@ -245,8 +319,7 @@ size_t RaceDetector::getAccessWorkGroup(const MemoryAccess& access) const
     return access.getEntity();
 }
 
-void RaceDetector::insert(AccessRecord& record,
-                          const MemoryAccess& access) const
+void RaceDetector::insert(AccessRecord& record, const MemoryAccess& access)
 {
   if (access.isLoad())
   {
@@ -319,7 +392,10 @@ void RaceDetector::logRace(const Race& race) const
         << Size3(race.a.getEntity(), m_kernelInvocation->getLocalSize());
   }
 
-  msg << endl << race.a.getInstruction() << endl << endl << "Second entity: ";
+  msg << endl
+      << getInstruction(race.a) << endl
+      << endl
+      << "Second entity: ";
 
   // Show details of other entity involved in race
   if (race.b.isWorkItem())
@@ -335,10 +411,31 @@ void RaceDetector::logRace(const Race& race) const
     msg << "Group"
         << Size3(race.b.getEntity(), m_kernelInvocation->getLocalSize());
   }
-  msg << endl << race.b.getInstruction() << endl;
+  msg << endl << getInstruction(race.b) << endl;
   msg.send();
 }
 
+void RaceDetector::mergeGlobalAccess(ShadowPage* page, size_t offset,
+                                     size_t address, size_t group,
+                                     const AccessRecord& a)
+{
+  AccessRecord b = page->getRecord(offset);
+
+  // Check for races with previous accesses
+  if (check(a.load, b.store) && getAccessWorkGroup(b.store) != group)
+    insertKernelRace({AddrSpaceGlobal, address, a.load, b.store});
+  if (check(a.store, b.load) && getAccessWorkGroup(b.load) != group)
+    insertKernelRace({AddrSpaceGlobal, address, a.store, b.load});
+  if (check(a.store, b.store) && getAccessWorkGroup(b.store) != group)
+    insertKernelRace({AddrSpaceGlobal, address, a.store, b.store});
+
+  // Insert accesses
+  if (a.load.isSet())
+    page->insert(offset, a.load);
+  if (a.store.isSet())
+    page->insert(offset, a.store);
+}
+
 void RaceDetector::registerAccess(const Memory* memory,
                                   const WorkGroup* workGroup,
                                   const WorkItem* workItem, size_t address,
@@ -363,7 +460,7 @@ void RaceDetector::registerAccess(const Memory* memory,
   }
   else
   {
-    index = STATE(workGroup).wiLocal.size() - 1;
+    index = STATE(workGroup).numWorkItems;
   }
 
   AccessMap& accesses = (addrSpace == AddrSpaceGlobal)
@@ -382,8 +479,7 @@ void RaceDetector::registerAccess(const Memory* memory,
 void RaceDetector::syncWorkItems(const Memory* memory, WorkGroupState& state,
                                  vector<AccessMap>& accesses)
 {
-  AccessMap wgAccesses(0, AccessMap::hasher(), AccessMap::key_equal(),
-                       state.wgGlobal.get_allocator());
+  AccessMap& wgAccesses = state.wgAccesses;
 
   for (size_t i = 0; i < state.numWorkItems + 1; i++)
   {
@@ -425,12 +521,82 @@ void RaceDetector::syncWorkItems(const Memory* memory, WorkGroupState& state,
     for (auto race : races)
       logRace(race);
   }
+
+  wgAccesses.clear();
+}
+
+RaceDetector::AccessMap::AccessMap()
+{
+  m_epoch = 1;
+}
+
+// Spread consecutive addresses across the table
+#define HASH_ADDRESS(address) (((address)*0x9E3779B97F4A7C15ULL) >> 24)
+
+RaceDetector::AccessRecord& RaceDetector::AccessMap::operator[](size_t address)
+{
+  // Keep the load factor below one half
+  if (2 * (m_entries.size() + 1) > m_slots.size())
+    rehash(m_slots.empty() ? 64 : m_slots.size() * 2);
+
+  size_t mask = m_slots.size() - 1;
+  size_t slot = HASH_ADDRESS(address) & mask;
+  while (m_slots[slot].epoch == m_epoch)
+  {
+    Entry& entry = m_entries[m_slots[slot].index];
+    if (entry.first == address)
+      return entry.second;
+    slot = (slot + 1) & mask;
+  }
+
+  m_slots[slot].epoch = m_epoch;
+  m_slots[slot].index = m_entries.size();
+  m_entries.push_back(Entry(address, AccessRecord()));
+  return m_entries.back().second;
+}
+
+void RaceDetector::AccessMap::clear()
+{
+  m_entries.clear();
+
+  // Slots from previous epochs are treated as empty, so only need to be
+  // reset when the epoch counter wraps around
+  if (++m_epoch == 0)
+  {
+    for (Slot& slot : m_slots)
+      slot.epoch = 0;
+    m_epoch = 1;
+  }
+}
+
+void RaceDetector::AccessMap::sort()
+{
+  std::sort(m_entries.begin(), m_entries.end(),
+            [](const Entry& a, const Entry& b) { return a.first < b.first; });
+  rehash(m_slots.size());
+}
+
+void RaceDetector::AccessMap::rehash(size_t capacity)
+{
+  m_slots.assign(capacity, {0, 0});
+  m_epoch = 1;
+
+  // Re-insert existing entries
+  size_t mask = capacity - 1;
+  for (size_t i = 0; i < m_entries.size(); i++)
+  {
+    size_t slot = HASH_ADDRESS(m_entries[i].first) & mask;
+    while (m_slots[slot].epoch == m_epoch)
+      slot = (slot + 1) & mask;
+    m_slots[slot].epoch = m_epoch;
+    m_slots[slot].index = i;
+  }
 }
 
 RaceDetector::MemoryAccess::MemoryAccess()
 {
   this->info = 0;
-  this->instruction = NULL;
+  this->instruction = 0;
 }
 
 RaceDetector::MemoryAccess::MemoryAccess(const WorkGroup* workGroup,
@@ -443,23 +609,27 @@ RaceDetector::MemoryAccess::MemoryAccess(const WorkGroup* workGroup,
   this->info |= store << STORE_BIT;
   this->info |= atomic << ATOMIC_BIT;
 
+  size_t entity;
   if (workItem)
   {
-    this->entity = workItem->getGlobalIndex();
-    this->instruction = workItem->getCurrentInstruction();
+    entity = workItem->getGlobalIndex();
+    this->instruction = workItem->getCurrentInstructionIndex() + 1;
   }
   else
   {
     this->info |= (1 << WG_BIT);
-    this->entity = workGroup->getGroupIndex();
-    this->instruction = NULL; // TODO?
+    entity = workGroup->getGroupIndex();
+    this->instruction = 0; // TODO?
   }
+  assert((uint64_t)entity >> 48 == 0 && "Entity exceeds 48 bits");
+  this->entityLow = entity;
+  this->entityHigh = (uint64_t)entity >> 32;
 }
 
 void RaceDetector::MemoryAccess::clear()
 {
   this->info = 0;
-  this->instruction = NULL;
+  this->instruction = 0;
 }
 
 bool RaceDetector::MemoryAccess::isSet() const
@@ -494,10 +664,10 @@ bool RaceDetector::MemoryAccess::isWorkItem() const
 
 size_t RaceDetector::MemoryAccess::getEntity() const
 {
-  return this->entity;
+  return ((uint64_t)this->entityHigh << 32) | this->entityLow;
 }
 
-const llvm::Instruction* RaceDetector::MemoryAccess::getInstruction() const
+unsigned RaceDetector::MemoryAccess::getInstruction() const
 {
   return this->instruction;
 }
@@ -515,6 +685,75 @@ void RaceDetector::MemoryAccess::setStoreData(uint8_t data)
 bool RaceDetector::MemoryAccess::operator==(
   const RaceDetector::MemoryAccess& other) const
 {
-  return this->entity == other.entity &&
+  return this->entityLow == other.entityLow &&
+         this->entityHigh == other.entityHigh &&
          this->instruction == other.instruction && this->info == other.info;
 }
+
+RaceDetector::ShadowWord::ShadowWord()
+{
+  this->loadMask = 0;
+  this->storeMask = 0;
+  this->split = false;
+}
+
+RaceDetector::AccessRecord
+RaceDetector::ShadowPage::getRecord(size_t offset) const
+{
+  size_t index = offset / WORD_SIZE;
+  unsigned byte = offset % WORD_SIZE;
+
+  const ShadowWord& word = this->words[index];
+  if (word.split)
+    return this->split.at(index)[byte];
+
+  // Expand word record to the record for this byte
+  AccessRecord record;
+  if (word.loadMask & (1 << byte))
+    record.load = word.load;
+  if (word.storeMask & (1 << byte))
+  {
+    record.store = word.store;
+    record.store.setStoreData(word.storeData[byte]);
+  }
+  return record;
+}
+
+void RaceDetector::ShadowPage::insert(size_t offset,
+                                      const MemoryAccess& access)
+{
+  size_t index = offset / WORD_SIZE;
+  unsigned byte = offset % WORD_SIZE;
+  uint8_t bit = 1 << byte;
+
+  ShadowWord& word = this->words[index];
+  if (!word.split)
+  {
+    MemoryAccess& current = access.isStore() ? word.store : word.load;
+    uint8_t& mask = access.isStore() ? word.storeMask : word.loadMask;
+
+    // Existing non-atomic accesses take precedence (as for AccessRecord)
+    if ((mask & bit) && !current.isAtomic())
+      return;
+
+    // Extend the word record if it can still represent every byte
+    if (!(mask & ~bit) || current == access)
+    {
+      if (!(mask & ~bit))
+        current = access;
+      mask |= bit;
+      if (access.isStore())
+        word.storeData[byte] = access.getStoreData();
+      return;
+    }
+
+    // Otherwise switch to separate records for each byte
+    std::array<AccessRecord, WORD_SIZE> records;
+    for (unsigned i = 0; i < WORD_SIZE; i++)
+      records[i] = getRecord(index * WORD_SIZE + i);
+    this->split[index] = records;
+    word.split = true;
+  }
+
+  RaceDetector::insert(this->split.at(index)[byte], access);
+}
@@ -8,14 +8,18 @@
 
 #include "core/Plugin.h"
 
+#include <array>
 #include <mutex>
 
 namespace oclgrind
 {
+class InterpreterCache;
+
 class RaceDetector : public Plugin
 {
 public:
   RaceDetector(const Context* context);
+  virtual ~RaceDetector();
 
   virtual void kernelBegin(const KernelInvocation* kernelInvocation) override;
   virtual void kernelEnd(const KernelInvocation* kernelInvocation) override;
@@ -44,12 +48,17 @@ public:
   virtual void workGroupBegin(const WorkGroup* workGroup) override;
   virtual void workGroupComplete(const WorkGroup* workGroup) override;
 
+  virtual Subscription getSubscribedEvents() const override;
+
 private:
   struct MemoryAccess
   {
   private:
-    size_t entity;
-    const llvm::Instruction* instruction;
+    // Entity is limited to 48 bits, and the instruction is identified by its
+    // index in the interpreter's instruction stream plus one (zero for none)
+    uint32_t instruction;
+    uint32_t entityLow;
+    uint16_t entityHigh;
 
     uint8_t info;
     static const unsigned SET_BIT = 0;
@@ -70,7 +79,7 @@ private:
     bool isWorkItem() const;
 
     size_t getEntity() const;
-    const llvm::Instruction* getInstruction() const;
+    unsigned getInstruction() const;
 
     uint8_t getStoreData() const;
     void setStoreData(uint8_t);
@@ -87,27 +96,93 @@ private:
     MemoryAccess store;
   };
   typedef std::vector<MemoryAccess> AccessList;
-  typedef std::unordered_map<
-    size_t, AccessRecord, std::hash<size_t>, std::equal_to<size_t>,
-    PoolAllocator<std::pair<const size_t, AccessRecord>, 8192>>
-    AccessMap;
 
-  std::unordered_map<size_t, std::vector<AccessRecord>> m_globalAccesses;
+  // Open-addressing hash table of access records indexed by address, with
+  // the records stored contiguously (and iterated) in insertion order.
+  // Clearing advances the epoch of the table rather than freeing storage.
+  class AccessMap
+  {
+  public:
+    typedef std::pair<size_t, AccessRecord> Entry;
+
+    AccessMap();
+
+    AccessRecord& operator[](size_t address);
+    std::vector<Entry>::iterator begin() { return m_entries.begin(); }
+    std::vector<Entry>::iterator end() { return m_entries.end(); }
+    void clear();
+    void sort();
+
+  private:
+    struct Slot
+    {
+      uint32_t epoch;
+      uint32_t index;
+    };
+    std::vector<Entry> m_entries;
+    std::vector<Slot> m_slots;
+    uint32_t m_epoch;
+
+    void rehash(size_t capacity);
+  };
+
+  // Shadow state for an aligned word of global memory, with a single load
+  // and store access each covering a subset of the bytes of the word
+  // (words with different accesses to different bytes are split into
+  // separate records for each byte)
+  static const unsigned WORD_SIZE = 4;
+  struct ShadowWord
+  {
+    MemoryAccess load;
+    MemoryAccess store;
+    uint8_t loadMask;
+    uint8_t storeMask;
+    uint8_t storeData[WORD_SIZE];
+    bool split;
+
+    ShadowWord();
+  };
+
+  // Shadow state for a page of a global memory buffer
+  static const unsigned SHADOW_PAGE_SIZE = 4096;
+  struct ShadowPage
+  {
+    ShadowWord words[SHADOW_PAGE_SIZE / WORD_SIZE];
+    std::unordered_map<size_t, std::array<AccessRecord, WORD_SIZE>> split;
+
+    AccessRecord getRecord(size_t offset) const;
+    void insert(size_t offset, const MemoryAccess& access);
+  };
+
+  // Page table for each buffer, with pages created on first access and
+  // released at the end of the kernel (pages not yet accessed are NULL)
+  std::unordered_map<size_t, std::vector<ShadowPage*>> m_globalAccesses;
   std::map<size_t, std::mutex*> m_globalMutexes;
 
+  // Pages (buffer and page index) created during the current kernel
+  std::mutex m_dirtyPagesMutex;
+  std::vector<std::pair<size_t, size_t>> m_dirtyPages;
+
+  ShadowPage* getShadowPage(size_t buffer, size_t page);
+
   struct WorkGroupState
   {
     size_t numWorkItems;
     std::vector<AccessMap> wiLocal;
     std::vector<AccessMap> wiGlobal;
     AccessMap wgGlobal;
+    AccessMap wgAccesses;
   };
   struct WorkerState
   {
-    std::unordered_map<const WorkGroup*, WorkGroupState>* groups;
+    std::unordered_map<const WorkGroup*, WorkGroupState*>* groups;
   };
   static THREAD_LOCAL WorkerState m_state;
 
+  // Work-group states are recycled, retaining the storage of their tables
+  std::mutex m_freeStatesMutex;
+  std::vector<WorkGroupState*> m_freeStates;
+
   struct Race
   {
     unsigned addrspace;
@@ -118,6 +193,7 @@ private:
 
   bool m_allowUniformWrites;
   const KernelInvocation* m_kernelInvocation;
+  const InterpreterCache* m_cache;
 
   std::mutex kernelRacesMutex;
   RaceList kernelRaces;
@@ -125,10 +201,13 @@ private:
   size_t getAccessWorkGroup(const MemoryAccess& access) const;
 
   bool check(const MemoryAccess& a, const MemoryAccess& b) const;
-  void insert(AccessRecord& record, const MemoryAccess& access) const;
+  const llvm::Instruction* getInstruction(const MemoryAccess& access) const;
+  static void insert(AccessRecord& record, const MemoryAccess& access);
   void insertKernelRace(const Race& race);
   void insertRace(RaceList& races, const Race& race) const;
   void logRace(const Race& race) const;
+  void mergeGlobalAccess(ShadowPage* page, size_t offset, size_t address,
+                         size_t group, const AccessRecord& a);
   void registerAccess(const Memory* memory, const WorkGroup* workGroup,
                       const WorkItem* workItem, size_t address, size_t size,
                       bool atomic, const uint8_t* storeData = NULL);
@@ -13,15 +13,18 @@
 #include "core/Kernel.h"
 #include "core/KernelInvocation.h"
 #include "core/Memory.h"
+#include "core/Program.h"
 #include "core/WorkGroup.h"
 #include "core/WorkItem.h"
 
 #include "llvm/IR/Argument.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 
 #include "Uninitialized.h"
+#include <algorithm>
 #include <mutex>
 
 using namespace oclgrind;
@@ -41,8 +44,22 @@ static std::mutex atomicShadowMutex[NUM_ATOMIC_MUTEXES];
 #define ATOMIC_MUTEX(offset)                                                   \
   atomicShadowMutex[(((offset) >> 2) & (NUM_ATOMIC_MUTEXES - 1))]
 
-THREAD_LOCAL ShadowContext::WorkSpace ShadowContext::m_workSpace = {NULL, NULL,
-                                                                    NULL, 0};
+// Materialised pages of global shadow memory are shared between threads
+#define NUM_PAGE_MUTEXES 256 // Must be power of two
+static std::mutex pageShadowMutex[NUM_PAGE_MUTEXES];
+#define PAGE_MUTEX(index, page)                                                \
+  pageShadowMutex[(((index) ^ (page)) & (NUM_PAGE_MUTEXES - 1))]
+
+THREAD_LOCAL ShadowContext::WorkSpace ShadowContext::m_workSpace = {
+  NULL, NULL, NULL, NULL, 0};
+
+// Local linear ID of a work-item, used to index its work-group's shadows
+static inline size_t getLocalIndex(const WorkItem* workItem)
+{
+  Size3 lid = workItem->getLocalID();
+  Size3 groupSize = workItem->getWorkGroup()->getGroupSize();
+  return lid.x + (lid.y + lid.z * groupSize.y) * groupSize.x;
+}
 
 Uninitialized::Uninitialized(const Context* context)
     : Plugin(context), shadowContext(sizeof(size_t) == 8 ? 32 : 16)
@@ -141,6 +158,68 @@ std::string Uninitialized::extractUnmangledName(const std::string fullname,
   }
 }
 
+Uninitialized::BuiltinHandler
+Uninitialized::findBuiltinHandler(const std::string& name)
+{
+  static const unordered_map<string, BuiltinHandler> handlers = {
+    {"any", &Uninitialized::handleAny},
+    {"async_work_group_copy", &Uninitialized::handleAsyncCopy},
+    {"async_work_group_strided_copy", &Uninitialized::handleAsyncCopy},
+    {"fract", &Uninitialized::handleFract},
+    {"frexp", &Uninitialized::handleFrexp},
+    {"lgamma_r", &Uninitialized::handleFrexp},
+    {"modf", &Uninitialized::handleFract},
+    {"read_imagef", &Uninitialized::handleReadImage},
+    {"read_imagei", &Uninitialized::handleReadImage},
+    {"read_imageui", &Uninitialized::handleReadImage},
+    {"remquo", &Uninitialized::handleRemquo},
+    {"select", &Uninitialized::handleSelect},
+    {"shuffle", &Uninitialized::handleShuffle},
+    {"shuffle2", &Uninitialized::handleShuffle2},
+    {"sincos", &Uninitialized::handleFract},
+    {"wait_group_events", &Uninitialized::handleWaitGroupEvents},
+    {"write_imagef", &Uninitialized::handleWriteImage},
+    {"write_imagei", &Uninitialized::handleWriteImage},
+    {"write_imageui", &Uninitialized::handleWriteImage},
+  };
+
+  // Prefixes are checked in order, so longer prefixes must come first
+  static const list<pair<string, BuiltinHandler>> prefixHandlers = {
+    {"atomic", &Uninitialized::handleAtomic},
+    {"get_image_", &Uninitialized::handleGetImageInfo},
+    {"vload_half", &Uninitialized::handleVloadHalf},
+    {"vloada_half", &Uninitialized::handleVloadHalf},
+    {"vstore_half", &Uninitialized::handleVstoreHalf},
+    {"vstorea_half", &Uninitialized::handleVstoreHalf},
+    {"vload", &Uninitialized::handleVload},
+    {"vstore", &Uninitialized::handleVstore},
+  };
+
+  auto handler = handlers.find(name);
+  if (handler != handlers.end())
+  {
+    return handler->second;
+  }
+
+  for (auto& prefix : prefixHandlers)
+  {
+    if (name.compare(0, prefix.first.length(), prefix.first) == 0)
+    {
+      return prefix.second;
+    }
+  }
+
+  return NULL;
+}
+
+Plugin::Subscription Uninitialized::getSubscribedEvents() const
+{
+  return (1 << HOST_MEMORY_STORE) | (1 << INSTRUCTION_EXECUTED) |
+         (1 << KERNEL_BEGIN) | (1 << KERNEL_END) | (1 << MEMORY_MAP) |
+         (1 << WORK_GROUP_BEGIN) | (1 << WORK_GROUP_COMPLETE) |
+         (1 << WORK_ITEM_BEGIN) | (1 << WORK_ITEM_COMPLETE);
+}
+
 ShadowMemory* Uninitialized::getShadowMemory(unsigned addrSpace,
                                              const WorkItem* workItem,
                                              const WorkGroup* workGroup) const
@@ -179,734 +258,815 @@ ShadowMemory* Uninitialized::getShadowMemory(unsigned addrSpace,
   }
 }
 
-bool Uninitialized::handleBuiltinFunction(const WorkItem* workItem, string name,
-                                          const llvm::CallInst* CI,
-                                          const TypedValue result)
+void Uninitialized::handleAny(const WorkItem* workItem,
+                              const llvm::CallInst* CI, const Builtin& builtin,
+                              const TypedValue& result)
 {
-  string paramTypes;
-  name = extractUnmangledName(name, paramTypes);
   ShadowValues* shadowValues =
     shadowContext.getShadowWorkItem(workItem)->getValues();
 
-  if (name == "async_work_group_copy" ||
-      name == "async_work_group_strided_copy")
-  {
-    int arg = 0;
+  const llvm::Value* argOp = CI->getArgOperand(0);
+  const llvm::Type* argType = argOp->getType();
+  TypedValue shadow = shadowContext.getValue(workItem, argOp);
 
-    // Get src/dest addresses
-    const llvm::Value* dstOp = CI->getArgOperand(arg++);
-    const llvm::Value* srcOp = CI->getArgOperand(arg++);
-    size_t dst = workItem->getOperand(dstOp).getPointer();
-    size_t src = workItem->getOperand(srcOp).getPointer();
+  unsigned num = 1;
+  if (argType->isVectorTy())
+  {
+    num = llvm::cast<llvm::FixedVectorType>(argType)->getNumElements();
+  }
 
-    // Get size of copy
-    unsigned elemSize;
-    char ptrtype = paramTypes[6];
-    switch (ptrtype)
+  for (unsigned i = 0; i < num; ++i)
+  {
+    if (ShadowContext::isCleanValue(shadow, i))
     {
-    case 'i':
-      elemSize = 4;
-      break;
-    default:
-      FATAL_ERROR("Unsupported argument type: %c", ptrtype);
-      break;
+      shadowValues->setValue(CI, ShadowContext::getCleanValue(result.size));
+      return;
     }
+  }
 
-    const llvm::Value* numOp = CI->getArgOperand(arg++);
-    uint64_t num = workItem->getOperand(numOp).getUInt();
-    TypedValue numShadow = shadowContext.getValue(workItem, numOp);
+  shadowValues->setValue(CI, ShadowContext::getPoisonedValue(result.size));
+}
 
-    if (!ShadowContext::isCleanValue(numShadow))
-    {
-      logUninitializedIndex();
-    }
+void Uninitialized::handleAsyncCopy(const WorkItem* workItem,
+                                    const llvm::CallInst* CI,
+                                    const Builtin& builtin,
+                                    const TypedValue& result)
+{
+  const string& name = builtin.name;
+  const string& paramTypes = builtin.paramTypes;
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
 
-    // Get stride
-    size_t stride = 1;
+  int arg = 0;
 
-    if (name == "async_work_group_strided_copy")
-    {
-      const llvm::Value* strideOp = CI->getArgOperand(arg++);
-      stride = workItem->getOperand(strideOp).getUInt();
-      TypedValue strideShadow = shadowContext.getValue(workItem, strideOp);
+  // Get src/dest addresses
+  const llvm::Value* dstOp = CI->getArgOperand(arg++);
+  const llvm::Value* srcOp = CI->getArgOperand(arg++);
+  size_t dst = workItem->getCurrentOperand(0).getPointer();
+  size_t src = workItem->getCurrentOperand(1).getPointer();
 
-      if (!ShadowContext::isCleanValue(strideShadow))
-      {
-        logUninitializedIndex();
-      }
-    }
+  // Get size of copy
+  unsigned elemSize;
+  char ptrtype = paramTypes[6];
+  switch (ptrtype)
+  {
+  case 'i':
+    elemSize = 4;
+    break;
+  default:
+    FATAL_ERROR("Unsupported argument type: %c", ptrtype);
+    break;
+  }
 
-    const llvm::Value* eventOp = CI->getArgOperand(arg++);
-    TypedValue eventShadow = shadowContext.getValue(workItem, eventOp);
+  const llvm::Value* numOp = CI->getArgOperand(arg);
+  uint64_t num = workItem->getCurrentOperand(arg++).getUInt();
+  TypedValue numShadow = shadowContext.getValue(workItem, numOp);
 
-    // Get type of copy
-    AddressSpace dstAddrSpace = AddrSpaceLocal;
-    AddressSpace srcAddrSpace = AddrSpaceLocal;
+  if (!ShadowContext::isCleanValue(numShadow))
+  {
+    logUninitializedIndex();
+  }
 
-    if (dstOp->getType()->getPointerAddressSpace() == AddrSpaceLocal)
-    {
-      srcAddrSpace = AddrSpaceGlobal;
-    }
-    else
+  // Get stride
+  size_t stride = 1;
+
+  if (name == "async_work_group_strided_copy")
+  {
+    const llvm::Value* strideOp = CI->getArgOperand(arg);
+    stride = workItem->getCurrentOperand(arg++).getUInt();
+    TypedValue strideShadow = shadowContext.getValue(workItem, strideOp);
+
+    if (!ShadowContext::isCleanValue(strideShadow))
     {
-      dstAddrSpace = AddrSpaceGlobal;
+      logUninitializedIndex();
     }
+  }
 
-    copyShadowMemoryStrided(dstAddrSpace, dst, srcAddrSpace, src, num, stride,
-                            elemSize, workItem);
-    shadowValues->setValue(CI, eventShadow);
+  const llvm::Value* eventOp = CI->getArgOperand(arg++);
+  TypedValue eventShadow = shadowContext.getValue(workItem, eventOp);
 
-    // Check shadow of src address
-    TypedValue srcShadow = shadowContext.getValue(workItem, srcOp);
+  // Get type of copy
+  AddressSpace dstAddrSpace = AddrSpaceLocal;
+  AddressSpace srcAddrSpace = AddrSpaceLocal;
 
-    if (!ShadowContext::isCleanValue(srcShadow))
-    {
-      logUninitializedAddress(srcAddrSpace, src, false);
-    }
+  if (dstOp->getType()->getPointerAddressSpace() == AddrSpaceLocal)
+  {
+    srcAddrSpace = AddrSpaceGlobal;
+  }
+  else
+  {
+    dstAddrSpace = AddrSpaceGlobal;
+  }
 
-    // Check shadow of dst address
-    TypedValue dstShadow = shadowContext.getValue(workItem, dstOp);
+  copyShadowMemoryStrided(dstAddrSpace, dst, srcAddrSpace, src, num, stride,
+                          elemSize, workItem);
+  shadowValues->setValue(CI, eventShadow);
 
-    if (!ShadowContext::isCleanValue(dstShadow))
-    {
-      logUninitializedAddress(dstAddrSpace, dst);
-    }
+  // Check shadow of src address
+  TypedValue srcShadow = shadowContext.getValue(workItem, srcOp);
 
-    return true;
+  if (!ShadowContext::isCleanValue(srcShadow))
+  {
+    logUninitializedAddress(srcAddrSpace, src, false);
   }
-  else if (name == "wait_group_events")
+
+  // Check shadow of dst address
+  TypedValue dstShadow = shadowContext.getValue(workItem, dstOp);
+
+  if (!ShadowContext::isCleanValue(dstShadow))
   {
-    const llvm::Value* Addr = CI->getArgOperand(1);
-    const llvm::Value* Num = CI->getArgOperand(0);
-    uint64_t num = workItem->getOperand(Num).getUInt();
-    size_t address = workItem->getOperand(Addr).getPointer();
+    logUninitializedAddress(dstAddrSpace, dst);
+  }
+}
 
-    TypedValue numShadow = shadowContext.getValue(workItem, Num);
-    TypedValue eventShadow = {sizeof(size_t), 1,
-                              new unsigned char[sizeof(size_t)]};
+void Uninitialized::handleAtomic(const WorkItem* workItem,
+                                 const llvm::CallInst* CI,
+                                 const Builtin& builtin,
+                                 const TypedValue& result)
+{
+  const string& name = builtin.name;
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
 
-    // Check shadow for the number of events
-    if (!ShadowContext::isCleanValue(numShadow))
+  if (name.compare(6, string::npos, "cmpxchg") == 0)
+  {
+    const llvm::Value* Addr = CI->getArgOperand(0);
+    unsigned addrSpace = Addr->getType()->getPointerAddressSpace();
+    size_t address = workItem->getCurrentOperand(0).getPointer();
+    uint32_t cmp = workItem->getCurrentOperand(1).getUInt();
+    uint32_t old = workItem->getOperand(CI).getUInt();
+    TypedValue argShadow =
+      shadowContext.getValue(workItem, CI->getArgOperand(2));
+    TypedValue cmpShadow =
+      shadowContext.getValue(workItem, CI->getArgOperand(1));
+    TypedValue oldShadow = {4, 1, shadowContext.getMemoryPool()->alloc(4)};
+
+    // Check shadow of the condition
+    if (!ShadowContext::isCleanValue(cmpShadow))
     {
       logUninitializedCF();
     }
 
-    for (unsigned i = 0; i < num; ++i)
+    // Perform cmpxchg
+    if (addrSpace == AddrSpaceGlobal)
     {
-      loadShadowMemory(AddrSpacePrivate, address, eventShadow, workItem);
+      shadowContext.getGlobalMemory()->lock(address);
+    }
 
-      if (!ShadowContext::isCleanValue(eventShadow))
-      {
-        logUninitializedCF();
-        delete[] eventShadow.data;
-        return true;
-      }
+    loadShadowMemory(addrSpace, address, oldShadow, workItem);
+
+    if (old == cmp)
+    {
+      storeShadowMemory(addrSpace, address, argShadow, workItem);
+    }
 
-      address += sizeof(size_t);
+    if (addrSpace == AddrSpaceGlobal)
+    {
+      shadowContext.getGlobalMemory()->unlock(address);
     }
 
-    delete[] eventShadow.data;
+    shadowValues->setValue(CI, oldShadow);
 
     // Check shadow of address
     TypedValue addrShadow = shadowContext.getValue(workItem, Addr);
 
     if (!ShadowContext::isCleanValue(addrShadow))
     {
-      logUninitializedAddress(AddrSpacePrivate, address, false);
+      logUninitializedAddress(addrSpace, address);
     }
 
-    return true;
+    return;
   }
-  else if (name.compare(0, 6, "atomic") == 0)
-  {
-    if (name.compare(6, string::npos, "cmpxchg") == 0)
-    {
-      const llvm::Value* Addr = CI->getArgOperand(0);
-      unsigned addrSpace = Addr->getType()->getPointerAddressSpace();
-      size_t address = workItem->getOperand(Addr).getPointer();
-      uint32_t cmp = workItem->getOperand(CI->getArgOperand(1)).getUInt();
-      uint32_t old = workItem->getOperand(CI).getUInt();
-      TypedValue argShadow =
-        shadowContext.getValue(workItem, CI->getArgOperand(2));
-      TypedValue cmpShadow =
-        shadowContext.getValue(workItem, CI->getArgOperand(1));
-      TypedValue oldShadow = {4, 1, shadowContext.getMemoryPool()->alloc(4)};
 
-      // Check shadow of the condition
-      if (!ShadowContext::isCleanValue(cmpShadow))
-      {
-        logUninitializedCF();
-      }
-
-      // Perform cmpxchg
-      if (addrSpace == AddrSpaceGlobal)
-      {
-        shadowContext.getGlobalMemory()->lock(address);
-      }
-
-      loadShadowMemory(addrSpace, address, oldShadow, workItem);
-
-      if (old == cmp)
-      {
-        storeShadowMemory(addrSpace, address, argShadow, workItem);
-      }
+  SimpleOrAtomic(workItem, CI);
+}
 
-      if (addrSpace == AddrSpaceGlobal)
-      {
-        shadowContext.getGlobalMemory()->unlock(address);
-      }
+bool Uninitialized::handleBuiltinFunction(const WorkItem* workItem,
+                                          const llvm::Function* function,
+                                          const llvm::CallInst* CI,
+                                          const TypedValue result)
+{
+  BuiltinMap::const_iterator itr = m_builtins.find(function);
+  if (itr == m_builtins.end())
+  {
+    return false;
+  }
 
-      shadowValues->setValue(CI, oldShadow);
+  (this->*itr->second.handler)(workItem, CI, itr->second, result);
+  return true;
+}
 
-      // Check shadow of address
-      TypedValue addrShadow = shadowContext.getValue(workItem, Addr);
+void Uninitialized::handleFract(const WorkItem* workItem,
+                                const llvm::CallInst* CI,
+                                const Builtin& builtin,
+                                const TypedValue& result)
+{
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
 
-      if (!ShadowContext::isCleanValue(addrShadow))
-      {
-        logUninitializedAddress(addrSpace, address);
-      }
+  const llvm::Value* Addr = CI->getArgOperand(1);
+  unsigned addrSpace = Addr->getType()->getPointerAddressSpace();
+  size_t iptr = workItem->getCurrentOperand(1).getPointer();
+  TypedValue argShadow =
+    shadowContext.getValue(workItem, CI->getArgOperand(0));
+  TypedValue newElemShadow;
+  TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
 
-      return true;
+  for (unsigned i = 0; i < result.num; ++i)
+  {
+    if (!ShadowContext::isCleanValue(argShadow, i))
+    {
+      newElemShadow = ShadowContext::getPoisonedValue(result.size);
     }
     else
     {
-      SimpleOrAtomic(workItem, CI);
-      return true;
+      newElemShadow = ShadowContext::getCleanValue(result.size);
     }
+
+    memcpy(newShadow.data, newElemShadow.data, result.size);
   }
-  else if (name == "fract" || name == "modf" || name == "sincos")
-  {
-    const llvm::Value* Addr = CI->getArgOperand(1);
-    unsigned addrSpace = Addr->getType()->getPointerAddressSpace();
-    size_t iptr = workItem->getOperand(Addr).getPointer();
-    TypedValue argShadow =
-      shadowContext.getValue(workItem, CI->getArgOperand(0));
-    TypedValue newElemShadow;
-    TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
 
-    for (unsigned i = 0; i < result.num; ++i)
-    {
-      if (!ShadowContext::isCleanValue(argShadow, i))
-      {
-        newElemShadow = ShadowContext::getPoisonedValue(result.size);
-      }
-      else
-      {
-        newElemShadow = ShadowContext::getCleanValue(result.size);
-      }
+  storeShadowMemory(addrSpace, iptr, newShadow);
+  shadowValues->setValue(CI, newShadow);
 
-      memcpy(newShadow.data, newElemShadow.data, result.size);
-    }
+  // Check shadow of address
+  TypedValue addrShadow = shadowContext.getValue(workItem, Addr);
 
-    storeShadowMemory(addrSpace, iptr, newShadow);
-    shadowValues->setValue(CI, newShadow);
+  if (!ShadowContext::isCleanValue(addrShadow))
+  {
+    logUninitializedAddress(addrSpace, iptr);
+  }
+}
 
-    // Check shadow of address
-    TypedValue addrShadow = shadowContext.getValue(workItem, Addr);
+void Uninitialized::handleFrexp(const WorkItem* workItem,
+                                const llvm::CallInst* CI,
+                                const Builtin& builtin,
+                                const TypedValue& result)
+{
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
 
-    if (!ShadowContext::isCleanValue(addrShadow))
-    {
-      logUninitializedAddress(addrSpace, iptr);
-    }
+  const llvm::Value* Addr = CI->getArgOperand(1);
+  unsigned addrSpace = Addr->getType()->getPointerAddressSpace();
+  size_t iptr = workItem->getCurrentOperand(1).getPointer();
+  TypedValue argShadow =
+    shadowContext.getValue(workItem, CI->getArgOperand(0));
+  TypedValue newElemShadow;
+  TypedValue newElemIntShadow;
+  TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
+  TypedValue newIntShadow = {newShadow.size, newShadow.num,
+                             shadowContext.getMemoryPool()->alloc(4)};
 
-    return true;
-  }
-  else if (name == "frexp" || name == "lgamma_r")
+  for (unsigned i = 0; i < result.num; ++i)
   {
-    const llvm::Value* Addr = CI->getArgOperand(1);
-    unsigned addrSpace = Addr->getType()->getPointerAddressSpace();
-    size_t iptr = workItem->getOperand(Addr).getPointer();
-    TypedValue argShadow =
-      shadowContext.getValue(workItem, CI->getArgOperand(0));
-    TypedValue newElemShadow;
-    TypedValue newElemIntShadow;
-    TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
-    TypedValue newIntShadow = {newShadow.size, newShadow.num,
-                               shadowContext.getMemoryPool()->alloc(4)};
-
-    for (unsigned i = 0; i < result.num; ++i)
+    if (!ShadowContext::isCleanValue(argShadow, i))
     {
-      if (!ShadowContext::isCleanValue(argShadow, i))
-      {
-        newElemShadow = ShadowContext::getPoisonedValue(result.size);
-        newElemIntShadow = ShadowContext::getPoisonedValue(4);
-      }
-      else
-      {
-        newElemShadow = ShadowContext::getCleanValue(result.size);
-        newElemIntShadow = ShadowContext::getCleanValue(4);
-      }
-
-      memcpy(newIntShadow.data, newElemIntShadow.data, 4);
-      memcpy(newShadow.data, newElemShadow.data, result.size);
+      newElemShadow = ShadowContext::getPoisonedValue(result.size);
+      newElemIntShadow = ShadowContext::getPoisonedValue(4);
     }
-
-    storeShadowMemory(addrSpace, iptr, newIntShadow);
-    shadowValues->setValue(CI, newShadow);
-
-    // Check shadow of address
-    TypedValue addrShadow = shadowContext.getValue(workItem, Addr);
-
-    if (!ShadowContext::isCleanValue(addrShadow))
+    else
     {
-      logUninitializedAddress(addrSpace, iptr);
+      newElemShadow = ShadowContext::getCleanValue(result.size);
+      newElemIntShadow = ShadowContext::getCleanValue(4);
     }
 
-    return true;
+    memcpy(newIntShadow.data, newElemIntShadow.data, 4);
+    memcpy(newShadow.data, newElemShadow.data, result.size);
   }
-  else if (name == "remquo")
-  {
-    const llvm::Value* Addr = CI->getArgOperand(2);
-    unsigned addrSpace = Addr->getType()->getPointerAddressSpace();
-    size_t iptr = workItem->getOperand(Addr).getPointer();
-    TypedValue arg0Shadow =
-      shadowContext.getValue(workItem, CI->getArgOperand(0));
-    TypedValue arg1Shadow =
-      shadowContext.getValue(workItem, CI->getArgOperand(1));
-    TypedValue newElemShadow;
-    TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
 
-    for (unsigned i = 0; i < result.num; ++i)
-    {
-      if (!ShadowContext::isCleanValue(arg0Shadow, i) ||
-          !ShadowContext::isCleanValue(arg1Shadow, i))
-      {
-        newElemShadow = ShadowContext::getPoisonedValue(result.size);
-      }
-      else
-      {
-        newElemShadow = ShadowContext::getCleanValue(result.size);
-      }
+  storeShadowMemory(addrSpace, iptr, newIntShadow);
+  shadowValues->setValue(CI, newShadow);
 
-      storeShadowMemory(addrSpace, iptr + i * 4, newElemShadow);
-      memcpy(newShadow.data, newElemShadow.data, result.size);
-    }
+  // Check shadow of address
+  TypedValue addrShadow = shadowContext.getValue(workItem, Addr);
 
-    shadowValues->setValue(CI, newShadow);
+  if (!ShadowContext::isCleanValue(addrShadow))
+  {
+    logUninitializedAddress(addrSpace, iptr);
+  }
+}
 
-    // Check shadow of address
-    TypedValue addrShadow = shadowContext.getValue(workItem, Addr);
+void Uninitialized::handleGetImageInfo(const WorkItem* workItem,
+                                       const llvm::CallInst* CI,
+                                       const Builtin& builtin,
+                                       const TypedValue& result)
+{
+  const string& name = builtin.name;
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
 
-    if (!ShadowContext::isCleanValue(addrShadow))
-    {
-      logUninitializedAddress(addrSpace, iptr);
-    }
+  TypedValue shadowImage =
+    shadowContext.getValue(workItem, CI->getArgOperand(0));
+  TypedValue newShadow = {
+    result.size, result.num,
+    shadowContext.getMemoryPool()->alloc(result.size * result.num)};
 
-    return true;
+  if (name == "get_image_array_size")
+  {
+    newShadow.setUInt(((Image*)shadowImage.data)->desc.image_array_size);
   }
-  else if (name == "shuffle")
+  else if (name == "get_image_dim")
   {
-    TypedValue mask = workItem->getOperand(CI->getArgOperand(1));
-    TypedValue maskShadow =
-      shadowContext.getValue(workItem, CI->getArgOperand(1));
-    TypedValue shadow = shadowContext.getValue(workItem, CI->getArgOperand(0));
-    TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
+    newShadow.setUInt(((Image*)shadowImage.data)->desc.image_width, 0);
+    newShadow.setUInt(((Image*)shadowImage.data)->desc.image_height, 1);
 
-    for (unsigned i = 0; i < newShadow.num; ++i)
+    if (newShadow.num > 2)
     {
-      if (!ShadowContext::isCleanValue(maskShadow, i))
-      {
-        TypedValue v = ShadowContext::getPoisonedValue(newShadow.size);
-        memcpy(newShadow.data + i * newShadow.size, v.data, newShadow.size);
-      }
-      else
-      {
-        size_t srcOffset = (mask.getUInt(i) % shadow.size) * shadow.size;
-        memcpy(newShadow.data + i * newShadow.size, shadow.data + srcOffset,
-               newShadow.size);
-      }
+      newShadow.setUInt(((Image*)shadowImage.data)->desc.image_depth, 2);
+      newShadow.setUInt(0, 3);
     }
-
-    shadowValues->setValue(CI, newShadow);
-    return true;
   }
-  else if (name == "shuffle2")
+  else if (name == "get_image_depth")
   {
-    TypedValue mask = workItem->getOperand(CI->getArgOperand(2));
-    TypedValue maskShadow =
-      shadowContext.getValue(workItem, CI->getArgOperand(2));
-    TypedValue shadow[] = {
-      shadowContext.getValue(workItem, CI->getArgOperand(0)),
-      shadowContext.getValue(workItem, CI->getArgOperand(1))};
-    TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
-
-    for (unsigned i = 0; i < newShadow.num; ++i)
-    {
-      uint64_t m = 1;
+    newShadow.setUInt(((Image*)shadowImage.data)->desc.image_depth);
+  }
+  else if (name == "get_image_height")
+  {
+    newShadow.setUInt(((Image*)shadowImage.data)->desc.image_height);
+  }
+  else if (name == "get_image_width")
+  {
+    newShadow.setUInt(((Image*)shadowImage.data)->desc.image_width);
+  }
+  else if (name == "get_image_channel_order")
+  {
+    newShadow.setUInt(((Image*)shadowImage.data)->format.image_channel_order);
+  }
+  else if (name == "get_image_channel_data_type")
+  {
+    newShadow.setUInt(
+      ((Image*)shadowImage.data)->format.image_channel_data_type);
+  }
 
-      const llvm::Type* arg0Type = CI->getArgOperand(0)->getType();
-      if (arg0Type->isVectorTy())
-      {
-        auto vecType = llvm::cast<llvm::FixedVectorType>(arg0Type);
-        m = vecType->getNumElements();
-      }
+  shadowValues->setValue(CI, newShadow);
+}
 
-      uint64_t src = 0;
-      uint64_t index = mask.getUInt(i) % (2 * m);
+void Uninitialized::handleReadImage(const WorkItem* workItem,
+                                    const llvm::CallInst* CI,
+                                    const Builtin& builtin,
+                                    const TypedValue& result)
+{
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
 
-      if (index >= m)
-      {
-        index -= m;
-        src = 1;
-      }
+  Image* image = *(Image**)(workItem->getCurrentOperand(0).data);
+  TypedValue shadowImage =
+    shadowContext.getValue(workItem, CI->getArgOperand(0));
+  TypedValue newShadow;
 
-      if (!ShadowContext::isCleanValue(maskShadow, i))
-      {
-        TypedValue v = ShadowContext::getPoisonedValue(newShadow.size);
-        memcpy(newShadow.data + i * newShadow.size, v.data, newShadow.size);
-      }
-      else
-      {
-        size_t srcOffset = index * shadow[src].size;
-        memcpy(newShadow.data + i * newShadow.size,
-               shadow[src].data + srcOffset, newShadow.size);
-      }
-    }
+  // FIXME: The new shadow should be loaded from memory
+  // and not generated based on the image description
+  // However, this currently requires to duplicate all functionality
+  // in WorkItemBuiltins.cpp for the image function
+  // Has to be changed in combination with the write functions
+  size_t address = image->address;
 
-    shadowValues->setValue(CI, newShadow);
-    return true;
+  if (!ShadowContext::isCleanImage(shadowImage))
+  {
+    newShadow = ShadowContext::getPoisonedValue(result);
   }
-  else if (name == "any")
+  else
   {
-    const llvm::Value* argOp = CI->getArgOperand(0);
-    const llvm::Type* argType = argOp->getType();
-    TypedValue shadow = shadowContext.getValue(workItem, argOp);
+    newShadow = ShadowContext::getCleanValue(result);
+  }
+
+  shadowValues->setValue(CI, newShadow);
 
-    unsigned num = 1;
-    if (argType->isVectorTy())
+  // Check image
+  if (!ShadowContext::isCleanImageAddress(shadowImage))
+  {
+    logUninitializedAddress(AddrSpaceGlobal, address, false);
+  }
+}
+
+void Uninitialized::handleRemquo(const WorkItem* workItem,
+                                 const llvm::CallInst* CI,
+                                 const Builtin& builtin,
+                                 const TypedValue& result)
+{
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
+
+  const llvm::Value* Addr = CI->getArgOperand(2);
+  unsigned addrSpace = Addr->getType()->getPointerAddressSpace();
+  size_t iptr = workItem->getCurrentOperand(2).getPointer();
+  TypedValue arg0Shadow =
+    shadowContext.getValue(workItem, CI->getArgOperand(0));
+  TypedValue arg1Shadow =
+    shadowContext.getValue(workItem, CI->getArgOperand(1));
+  TypedValue newElemShadow;
+  TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
+
+  for (unsigned i = 0; i < result.num; ++i)
+  {
+    if (!ShadowContext::isCleanValue(arg0Shadow, i) ||
+        !ShadowContext::isCleanValue(arg1Shadow, i))
     {
-      num = llvm::cast<llvm::FixedVectorType>(argType)->getNumElements();
+      newElemShadow = ShadowContext::getPoisonedValue(result.size);
     }
-
-    for (unsigned i = 0; i < num; ++i)
+    else
     {
-      if (ShadowContext::isCleanValue(shadow, i))
-      {
-        shadowValues->setValue(CI, ShadowContext::getCleanValue(result.size));
-        return true;
-      }
+      newElemShadow = ShadowContext::getCleanValue(result.size);
     }
 
-    shadowValues->setValue(CI, ShadowContext::getPoisonedValue(result.size));
-    return true;
+    storeShadowMemory(addrSpace, iptr + i * 4, newElemShadow);
+    memcpy(newShadow.data, newElemShadow.data, result.size);
   }
-  else if (name == "select")
-  {
-    TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
-    TypedValue shadow[] = {
-      shadowContext.getValue(workItem, CI->getArgOperand(0)),
-      shadowContext.getValue(workItem, CI->getArgOperand(1))};
-    TypedValue selectShadow =
-      shadowContext.getValue(workItem, CI->getArgOperand(2));
 
-    for (unsigned i = 0; i < newShadow.num; ++i)
-    {
-      int64_t c = workItem->getOperand(CI->getArgOperand(2)).getSInt(i);
-      uint64_t src = ((newShadow.num > 1) ? c & INT64_MIN : c) ? 1 : 0;
+  shadowValues->setValue(CI, newShadow);
 
-      if (!ShadowContext::isCleanValue(selectShadow, i))
-      {
-        TypedValue v = ShadowContext::getPoisonedValue(newShadow.size);
-        memcpy(newShadow.data + i * newShadow.size, v.data, newShadow.size);
-      }
-      else
-      {
-        size_t srcOffset = i * shadow[src].size;
-        memcpy(newShadow.data + i * newShadow.size,
-               shadow[src].data + srcOffset, newShadow.size);
-      }
-    }
+  // Check shadow of address
+  TypedValue addrShadow = shadowContext.getValue(workItem, Addr);
 
-    shadowValues->setValue(CI, newShadow);
-    return true;
-  }
-  else if (name.compare(0, 10, "vload_half") == 0 ||
-           name.compare(0, 11, "vloada_half") == 0)
+  if (!ShadowContext::isCleanValue(addrShadow))
   {
-    const llvm::Value* BaseOp = CI->getArgOperand(1);
-    const llvm::Value* OffsetOp = CI->getArgOperand(0);
-    size_t base = workItem->getOperand(BaseOp).getPointer();
-    unsigned int addressSpace = BaseOp->getType()->getPointerAddressSpace();
-    uint64_t offset = workItem->getOperand(OffsetOp).getUInt();
+    logUninitializedAddress(addrSpace, iptr);
+  }
+}
 
-    size_t address;
+void Uninitialized::handleSelect(const WorkItem* workItem,
+                                 const llvm::CallInst* CI,
+                                 const Builtin& builtin,
+                                 const TypedValue& result)
+{
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
+
+  TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
+  TypedValue shadow[] = {
+    shadowContext.getValue(workItem, CI->getArgOperand(0)),
+    shadowContext.getValue(workItem, CI->getArgOperand(1))};
+  TypedValue selectShadow =
+    shadowContext.getValue(workItem, CI->getArgOperand(2));
+
+  for (unsigned i = 0; i < newShadow.num; ++i)
+  {
+    int64_t c = workItem->getCurrentOperand(2).getSInt(i);
+    uint64_t src = ((newShadow.num > 1) ? c & INT64_MIN : c) ? 1 : 0;
 
-    if (name.compare(0, 6, "vloada") == 0 && result.num == 3)
+    if (!ShadowContext::isCleanValue(selectShadow, i))
     {
-      address = base + offset * sizeof(cl_half) * 4;
+      TypedValue v = ShadowContext::getPoisonedValue(newShadow.size);
+      memcpy(newShadow.data + i * newShadow.size, v.data, newShadow.size);
     }
     else
     {
-      address = base + offset * sizeof(cl_half) * result.num;
+      size_t srcOffset = i * shadow[src].size;
+      memcpy(newShadow.data + i * newShadow.size,
+             shadow[src].data + srcOffset, newShadow.size);
     }
+  }
 
-    TypedValue halfShadow = {
-      sizeof(cl_half), result.num,
-      shadowContext.getMemoryPool()->alloc(2 * result.num)};
-    TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
+  shadowValues->setValue(CI, newShadow);
+}
 
-    loadShadowMemory(addressSpace, address, halfShadow, workItem);
+void Uninitialized::handleShuffle(const WorkItem* workItem,
+                                  const llvm::CallInst* CI,
+                                  const Builtin& builtin,
+                                  const TypedValue& result)
+{
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
 
-    TypedValue pv = ShadowContext::getPoisonedValue(newShadow.size);
-    TypedValue cv = ShadowContext::getCleanValue(newShadow.size);
+  TypedValue mask = workItem->getCurrentOperand(1);
+  TypedValue maskShadow =
+    shadowContext.getValue(workItem, CI->getArgOperand(1));
+  TypedValue shadow = shadowContext.getValue(workItem, CI->getArgOperand(0));
+  TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
 
-    // Convert to float shadows
-    for (unsigned i = 0; i < newShadow.num; ++i)
+  for (unsigned i = 0; i < newShadow.num; ++i)
+  {
+    if (!ShadowContext::isCleanValue(maskShadow, i))
     {
-      if (!ShadowContext::isCleanValue(halfShadow, i))
-      {
-        memcpy(newShadow.data + i * newShadow.size, pv.data, newShadow.size);
-      }
-      else
-      {
-        memcpy(newShadow.data + i * newShadow.size, cv.data, newShadow.size);
-      }
+      TypedValue v = ShadowContext::getPoisonedValue(newShadow.size);
+      memcpy(newShadow.data + i * newShadow.size, v.data, newShadow.size);
+    }
+    else
+    {
+      size_t srcOffset = (mask.getUInt(i) % shadow.size) * shadow.size;
+      memcpy(newShadow.data + i * newShadow.size, shadow.data + srcOffset,
+             newShadow.size);
     }
+  }
 
-    shadowValues->setValue(CI, newShadow);
+  shadowValues->setValue(CI, newShadow);
+}
 
-    // Check shadow of address
-    TypedValue baseShadow = shadowContext.getValue(workItem, BaseOp);
-    TypedValue offsetShadow = shadowContext.getValue(workItem, OffsetOp);
+void Uninitialized::handleShuffle2(const WorkItem* workItem,
+                                   const llvm::CallInst* CI,
+                                   const Builtin& builtin,
+                                   const TypedValue& result)
+{
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
 
-    if (!ShadowContext::isCleanValue(baseShadow) ||
-        !ShadowContext::isCleanValue(offsetShadow))
-    {
-      logUninitializedAddress(addressSpace, address, false);
-    }
+  TypedValue mask = workItem->getCurrentOperand(2);
+  TypedValue maskShadow =
+    shadowContext.getValue(workItem, CI->getArgOperand(2));
+  TypedValue shadow[] = {
+    shadowContext.getValue(workItem, CI->getArgOperand(0)),
+    shadowContext.getValue(workItem, CI->getArgOperand(1))};
+  TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
 
-    return true;
-  }
-  else if (name.compare(0, 11, "vstore_half") == 0 ||
-           name.compare(0, 12, "vstorea_half") == 0)
+  for (unsigned i = 0; i < newShadow.num; ++i)
   {
-    const llvm::Value* value = CI->getArgOperand(0);
-    unsigned size = getTypeSize(value->getType());
+    uint64_t m = 1;
 
-    if (isVector3(value))
+    const llvm::Type* arg0Type = CI->getArgOperand(0)->getType();
+    if (arg0Type->isVectorTy())
     {
-      // 3-element vectors are same size as 4-element vectors,
-      // but vstore address offset shouldn't use this.
-      size = (size / 4) * 3;
+      auto vecType = llvm::cast<llvm::FixedVectorType>(arg0Type);
+      m = vecType->getNumElements();
     }
 
-    const llvm::Value* BaseOp = CI->getArgOperand(2);
-    const llvm::Value* OffsetOp = CI->getArgOperand(1);
-    size_t base = workItem->getOperand(BaseOp).getPointer();
-    unsigned int addressSpace = BaseOp->getType()->getPointerAddressSpace();
-    uint64_t offset = workItem->getOperand(OffsetOp).getUInt();
-
-    // Convert to halfs
-    TypedValue shadow = shadowContext.getValue(workItem, value);
-    unsigned num = size / sizeof(float);
-    size = num * sizeof(cl_half);
-    TypedValue halfShadow = {sizeof(cl_half), num,
-                             shadowContext.getMemoryPool()->alloc(2 * num)};
+    uint64_t src = 0;
+    uint64_t index = mask.getUInt(i) % (2 * m);
 
-    TypedValue pv = ShadowContext::getPoisonedValue(halfShadow.size);
-    TypedValue cv = ShadowContext::getCleanValue(halfShadow.size);
-
-    for (unsigned i = 0; i < num; i++)
+    if (index >= m)
     {
-      if (!ShadowContext::isCleanValue(shadow, i))
-      {
-        memcpy(halfShadow.data + i * halfShadow.size, pv.data, halfShadow.size);
-      }
-      else
-      {
-        memcpy(halfShadow.data + i * halfShadow.size, cv.data, halfShadow.size);
-      }
+      index -= m;
+      src = 1;
     }
 
-    size_t address;
-    if (name.compare(0, 7, "vstorea") == 0 && num == 3)
+    if (!ShadowContext::isCleanValue(maskShadow, i))
     {
-      address = base + offset * sizeof(cl_half) * 4;
+      TypedValue v = ShadowContext::getPoisonedValue(newShadow.size);
+      memcpy(newShadow.data + i * newShadow.size, v.data, newShadow.size);
     }
     else
     {
-      address = base + offset * sizeof(cl_half) * num;
+      size_t srcOffset = index * shadow[src].size;
+      memcpy(newShadow.data + i * newShadow.size,
+             shadow[src].data + srcOffset, newShadow.size);
     }
+  }
 
-    storeShadowMemory(addressSpace, address, halfShadow, workItem);
+  shadowValues->setValue(CI, newShadow);
+}
 
-    // Check shadow of address
-    TypedValue baseShadow = shadowContext.getValue(workItem, BaseOp);
-    TypedValue offsetShadow = shadowContext.getValue(workItem, OffsetOp);
+void Uninitialized::handleVload(const WorkItem* workItem,
+                                const llvm::CallInst* CI,
+                                const Builtin& builtin,
+                                const TypedValue& result)
+{
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
+
+  TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
+  const llvm::Value* BaseOp = CI->getArgOperand(1);
+  const llvm::Value* OffsetOp = CI->getArgOperand(0);
+  unsigned int addressSpace = BaseOp->getType()->getPointerAddressSpace();
+  size_t base = workItem->getCurrentOperand(1).getPointer();
+  uint64_t offset = workItem->getCurrentOperand(0).getUInt();
+
+  size_t size = newShadow.size * newShadow.num;
+  size_t address = base + offset * size;
+  loadShadowMemory(addressSpace, address, newShadow, workItem);
+
+  shadowValues->setValue(CI, newShadow);
+
+  // Check shadow of address
+  TypedValue baseShadow = shadowContext.getValue(workItem, BaseOp);
+  TypedValue offsetShadow = shadowContext.getValue(workItem, OffsetOp);
 
-    if (!ShadowContext::isCleanValue(baseShadow) ||
-        !ShadowContext::isCleanValue(offsetShadow))
+  if (!ShadowContext::isCleanValue(baseShadow) ||
+      !ShadowContext::isCleanValue(offsetShadow))
+  {
+    logUninitializedAddress(addressSpace, address, false);
+  }
+}
+
+void Uninitialized::handleVloadHalf(const WorkItem* workItem,
+                                    const llvm::CallInst* CI,
+                                    const Builtin& builtin,
+                                    const TypedValue& result)
+{
+  const string& name = builtin.name;
+  ShadowValues* shadowValues =
+    shadowContext.getShadowWorkItem(workItem)->getValues();
+
+  const llvm::Value* BaseOp = CI->getArgOperand(1);
+  const llvm::Value* OffsetOp = CI->getArgOperand(0);
+  size_t base = workItem->getCurrentOperand(1).getPointer();
+  unsigned int addressSpace = BaseOp->getType()->getPointerAddressSpace();
+  uint64_t offset = workItem->getCurrentOperand(0).getUInt();
+
+  size_t address;
+
+  if (name.compare(0, 6, "vloada") == 0 && result.num == 3)
+  {
+    address = base + offset * sizeof(cl_half) * 4;
+  }
+  else
+  {
+    address = base + offset * sizeof(cl_half) * result.num;
+  }
+
+  TypedValue halfShadow = {
+    sizeof(cl_half), result.num,
+    shadowContext.getMemoryPool()->alloc(2 * result.num)};
+  TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
+
+  loadShadowMemory(addressSpace, address, halfShadow, workItem);
+
+  TypedValue pv = ShadowContext::getPoisonedValue(newShadow.size);
+  TypedValue cv = ShadowContext::getCleanValue(newShadow.size);
+
+  // Convert to float shadows
+  for (unsigned i = 0; i < newShadow.num; ++i)
+  {
+    if (!ShadowContext::isCleanValue(halfShadow, i))
     {
-      logUninitializedAddress(addressSpace, address);
+      memcpy(newShadow.data + i * newShadow.size, pv.data, newShadow.size);
+    }
+    else
+    {
+      memcpy(newShadow.data + i * newShadow.size, cv.data, newShadow.size);
     }
-    return true;
   }
-  else if (name.compare(0, 5, "vload") == 0)
+
+  shadowValues->setValue(CI, newShadow);
+
+  // Check shadow of address
+  TypedValue baseShadow = shadowContext.getValue(workItem, BaseOp);
+  TypedValue offsetShadow = shadowContext.getValue(workItem, OffsetOp);
+
+  if (!ShadowContext::isCleanValue(baseShadow) ||
+      !ShadowContext::isCleanValue(offsetShadow))
   {
-    TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
-    const llvm::Value* BaseOp = CI->getArgOperand(1);
-    const llvm::Value* OffsetOp = CI->getArgOperand(0);
-    unsigned int addressSpace = BaseOp->getType()->getPointerAddressSpace();
-    size_t base = workItem->getOperand(BaseOp).getPointer();
-    uint64_t offset = workItem->getOperand(OffsetOp).getUInt();
+    logUninitializedAddress(addressSpace, address, false);
+  }
+}
+
+void Uninitialized::handleVstore(const WorkItem* workItem,
+                                 const llvm::CallInst* CI,
+                                 const Builtin& builtin,
+                                 const TypedValue& result)
+{
+  const llvm::Value* value = CI->getArgOperand(0);
+  unsigned size = getTypeSize(value->getType());
 
-    size_t size = newShadow.size * newShadow.num;
-    size_t address = base + offset * size;
-    loadShadowMemory(addressSpace, address, newShadow, workItem);
+  if (isVector3(value))
+  {
+    // 3-element vectors are same size as 4-element vectors,
+    // but vstore address offset shouldn't use this.
+    size = (size / 4) * 3;
+  }
 
-    shadowValues->setValue(CI, newShadow);
+  const llvm::Value* BaseOp = CI->getArgOperand(2);
+  const llvm::Value* OffsetOp = CI->getArgOperand(1);
+  unsigned int addressSpace = BaseOp->getType()->getPointerAddressSpace();
+  size_t base = workItem->getCurrentOperand(2).getPointer();
+  uint64_t offset = workItem->getCurrentOperand(1).getUInt();
 
-    // Check shadow of address
-    TypedValue baseShadow = shadowContext.getValue(workItem, BaseOp);
-    TypedValue offsetShadow = shadowContext.getValue(workItem, OffsetOp);
+  size_t address = base + offset * size;
+  TypedValue shadow = shadowContext.getValue(workItem, value);
+  storeShadowMemory(addressSpace, address, shadow, workItem);
 
-    if (!ShadowContext::isCleanValue(baseShadow) ||
-        !ShadowContext::isCleanValue(offsetShadow))
-    {
-      logUninitializedAddress(addressSpace, address, false);
-    }
+  // Check shadow of address
+  TypedValue baseShadow = shadowContext.getValue(workItem, BaseOp);
+  TypedValue offsetShadow = shadowContext.getValue(workItem, OffsetOp);
 
-    return true;
-  }
-  else if (name.compare(0, 6, "vstore") == 0)
+  if (!ShadowContext::isCleanValue(baseShadow) ||
+      !ShadowContext::isCleanValue(offsetShadow))
   {
-    const llvm::Value* value = CI->getArgOperand(0);
-    unsigned size = getTypeSize(value->getType());
-
-    if (isVector3(value))
-    {
-      // 3-element vectors are same size as 4-element vectors,
-      // but vstore address offset shouldn't use this.
-      size = (size / 4) * 3;
-    }
+    logUninitializedAddress(addressSpace, address);
+  }
+}
 
-    const llvm::Value* BaseOp = CI->getArgOperand(2);
-    const llvm::Value* OffsetOp = CI->getArgOperand(1);
-    unsigned int addressSpace = BaseOp->getType()->getPointerAddressSpace();
-    size_t base = workItem->getOperand(BaseOp).getPointer();
-    uint64_t offset = workItem->getOperand(OffsetOp).getUInt();
+void Uninitialized::handleVstoreHalf(const WorkItem* workItem,
+                                     const llvm::CallInst* CI,
+                                     const Builtin& builtin,
+                                     const TypedValue& result)
+{
+  const string& name = builtin.name;
 
-    size_t address = base + offset * size;
-    TypedValue shadow = shadowContext.getValue(workItem, value);
-    storeShadowMemory(addressSpace, address, shadow, workItem);
+  const llvm::Value* value = CI->getArgOperand(0);
+  unsigned size = getTypeSize(value->getType());
 
-    // Check shadow of address
-    TypedValue baseShadow = shadowContext.getValue(workItem, BaseOp);
-    TypedValue offsetShadow = shadowContext.getValue(workItem, OffsetOp);
+  if (isVector3(value))
+  {
+    // 3-element vectors are same size as 4-element vectors,
+    // but vstore address offset shouldn't use this.
+    size = (size / 4) * 3;
+  }
 
-    if (!ShadowContext::isCleanValue(baseShadow) ||
-        !ShadowContext::isCleanValue(offsetShadow))
-    {
-      logUninitializedAddress(addressSpace, address);
-    }
+  const llvm::Value* BaseOp = CI->getArgOperand(2);
+  const llvm::Value* OffsetOp = CI->getArgOperand(1);
+  size_t base = workItem->getCurrentOperand(2).getPointer();
+  unsigned int addressSpace = BaseOp->getType()->getPointerAddressSpace();
+  uint64_t offset = workItem->getCurrentOperand(1).getUInt();
 
-    return true;
-  }
-  else if (name == "read_imagef" || name == "read_imagei" ||
-           name == "read_imageui")
-  {
-    Image* image = *(Image**)(workItem->getOperand(CI->getArgOperand(0)).data);
-    TypedValue shadowImage =
-      shadowContext.getValue(workItem, CI->getArgOperand(0));
-    TypedValue newShadow;
+  // Convert to halfs
+  TypedValue shadow = shadowContext.getValue(workItem, value);
+  unsigned num = size / sizeof(float);
+  size = num * sizeof(cl_half);
+  TypedValue halfShadow = {sizeof(cl_half), num,
+                           shadowContext.getMemoryPool()->alloc(2 * num)};
 
-    // FIXME: The new shadow should be loaded from memory
-    // and not generated based on the image description
-    // However, this currently requires to duplicate all functionality
-    // in WorkItemBuiltins.cpp for the image function
-    // Has to be changed in combination with the write functions
-    size_t address = image->address;
+  TypedValue pv = ShadowContext::getPoisonedValue(halfShadow.size);
+  TypedValue cv = ShadowContext::getCleanValue(halfShadow.size);
 
-    if (!ShadowContext::isCleanImage(shadowImage))
+  for (unsigned i = 0; i < num; i++)
+  {
+    if (!ShadowContext::isCleanValue(shadow, i))
     {
-      newShadow = ShadowContext::getPoisonedValue(result);
+      memcpy(halfShadow.data + i * halfShadow.size, pv.data, halfShadow.size);
     }
     else
     {
-      newShadow = ShadowContext::getCleanValue(result);
+      memcpy(halfShadow.data + i * halfShadow.size, cv.data, halfShadow.size);
     }
+  }
 
-    shadowValues->setValue(CI, newShadow);
+  size_t address;
+  if (name.compare(0, 7, "vstorea") == 0 && num == 3)
+  {
+    address = base + offset * sizeof(cl_half) * 4;
+  }
+  else
+  {
+    address = base + offset * sizeof(cl_half) * num;
+  }
 
-    // Check image
-    if (!ShadowContext::isCleanImageAddress(shadowImage))
-    {
-      logUninitializedAddress(AddrSpaceGlobal, address, false);
-    }
+  storeShadowMemory(addressSpace, address, halfShadow, workItem);
 
-    return true;
-  }
-  else if (name == "write_imagef" || name == "write_imagei" ||
-           name == "write_imageui")
+  // Check shadow of address
+  TypedValue baseShadow = shadowContext.getValue(workItem, BaseOp);
+  TypedValue offsetShadow = shadowContext.getValue(workItem, OffsetOp);
+
+  if (!ShadowContext::isCleanValue(baseShadow) ||
+      !ShadowContext::isCleanValue(offsetShadow))
   {
-    Image* image = *(Image**)(workItem->getOperand(CI->getArgOperand(0)).data);
-    TypedValue shadowImage =
-      shadowContext.getValue(workItem, CI->getArgOperand(0));
+    logUninitializedAddress(addressSpace, address);
+  }
+}
 
-    // FIXME: The actual shadow of the image should be stored to memory
-    // However, this currently requires to duplicate all functionality
-    // in WorkItemBuiltins.cpp for the image function
-    // Has to be changed in combination with the read functions
-    size_t address = image->address;
+void Uninitialized::handleWaitGroupEvents(const WorkItem* workItem,
+                                          const llvm::CallInst* CI,
+                                          const Builtin& builtin,
+                                          const TypedValue& result)
+{
+  const llvm::Value* Addr = CI->getArgOperand(1);
+  const llvm::Value* Num = CI->getArgOperand(0);
+  uint64_t num = workItem->getCurrentOperand(0).getUInt();
+  size_t address = workItem->getCurrentOperand(1).getPointer();
 
-    // Check image
-    if (!ShadowContext::isCleanImageAddress(shadowImage))
-    {
-      logUninitializedAddress(AddrSpaceGlobal, address);
-    }
+  TypedValue numShadow = shadowContext.getValue(workItem, Num);
+  TypedValue eventShadow = {sizeof(size_t), 1,
+                            new unsigned char[sizeof(size_t)]};
 
-    return true;
+  // Check shadow for the number of events
+  if (!ShadowContext::isCleanValue(numShadow))
+  {
+    logUninitializedCF();
   }
-  else if (name.compare(0, 10, "get_image_") == 0)
+
+  for (unsigned i = 0; i < num; ++i)
   {
-    TypedValue shadowImage =
-      shadowContext.getValue(workItem, CI->getArgOperand(0));
-    TypedValue newShadow = {
-      result.size, result.num,
-      shadowContext.getMemoryPool()->alloc(result.size * result.num)};
+    loadShadowMemory(AddrSpacePrivate, address, eventShadow, workItem);
 
-    if (name == "get_image_array_size")
+    if (!ShadowContext::isCleanValue(eventShadow))
     {
-      newShadow.setUInt(((Image*)shadowImage.data)->desc.image_array_size);
+      logUninitializedCF();
+      delete[] eventShadow.data;
+      return;
     }
-    else if (name == "get_image_dim")
-    {
-      newShadow.setUInt(((Image*)shadowImage.data)->desc.image_width, 0);
-      newShadow.setUInt(((Image*)shadowImage.data)->desc.image_height, 1);
 
-      if (newShadow.num > 2)
-      {
-        newShadow.setUInt(((Image*)shadowImage.data)->desc.image_depth, 2);
-        newShadow.setUInt(0, 3);
-      }
-    }
-    else if (name == "get_image_depth")
-    {
-      newShadow.setUInt(((Image*)shadowImage.data)->desc.image_depth);
-    }
-    else if (name == "get_image_height")
-    {
-      newShadow.setUInt(((Image*)shadowImage.data)->desc.image_height);
-    }
-    else if (name == "get_image_width")
-    {
-      newShadow.setUInt(((Image*)shadowImage.data)->desc.image_width);
-    }
-    else if (name == "get_image_channel_order")
-    {
-      newShadow.setUInt(((Image*)shadowImage.data)->format.image_channel_order);
-    }
-    else if (name == "get_image_channel_data_type")
-    {
-      newShadow.setUInt(
-        ((Image*)shadowImage.data)->format.image_channel_data_type);
-    }
+    address += sizeof(size_t);
+  }
 
-    shadowValues->setValue(CI, newShadow);
-    return true;
+  delete[] eventShadow.data;
+
+  // Check shadow of address
+  TypedValue addrShadow = shadowContext.getValue(workItem, Addr);
+
+  if (!ShadowContext::isCleanValue(addrShadow))
+  {
+    logUninitializedAddress(AddrSpacePrivate, address, false);
   }
+}
+
+void Uninitialized::handleWriteImage(const WorkItem* workItem,
+                                     const llvm::CallInst* CI,
+                                     const Builtin& builtin,
+                                     const TypedValue& result)
+{
+  Image* image = *(Image**)(workItem->getCurrentOperand(0).data);
+  TypedValue shadowImage =
+    shadowContext.getValue(workItem, CI->getArgOperand(0));
+
+  // FIXME: The actual shadow of the image should be stored to memory
+  // However, this currently requires to duplicate all functionality
+  // in WorkItemBuiltins.cpp for the image function
+  // Has to be changed in combination with the read functions
+  size_t address = image->address;
 
-  return false;
+  // Check image
+  if (!ShadowContext::isCleanImageAddress(shadowImage))
+  {
+    logUninitializedAddress(AddrSpaceGlobal, address);
+  }
 }
 
 void Uninitialized::handleIntrinsicInstruction(const WorkItem* workItem,
@@ -928,9 +1088,9 @@ void Uninitialized::handleIntrinsicInstruction(const WorkItem* workItem,
     const llvm::MemCpyInst* memcpyInst = (const llvm::MemCpyInst*)I;
     const llvm::Value* dstOp = memcpyInst->getDest();
     const llvm::Value* srcOp = memcpyInst->getSource();
-    size_t dst = workItem->getOperand(dstOp).getPointer();
-    size_t src = workItem->getOperand(srcOp).getPointer();
-    size_t size = workItem->getOperand(memcpyInst->getLength()).getUInt();
+    size_t dst = workItem->getCurrentOperand(0).getPointer();
+    size_t src = workItem->getCurrentOperand(1).getPointer();
+    size_t size = workItem->getCurrentOperand(2).getUInt();
     unsigned dstAddrSpace = memcpyInst->getDestAddressSpace();
     unsigned srcAddrSpace = memcpyInst->getSourceAddressSpace();
 
@@ -964,8 +1124,8 @@ void Uninitialized::handleIntrinsicInstruction(const WorkItem* workItem,
   {
     const llvm::MemSetInst* memsetInst = (const llvm::MemSetInst*)I;
     const llvm::Value* Addr = memsetInst->getDest();
-    size_t dst = workItem->getOperand(Addr).getPointer();
-    unsigned size = workItem->getOperand(memsetInst->getLength()).getUInt();
+    size_t dst = workItem->getCurrentOperand(0).getPointer();
+    unsigned size = workItem->getCurrentOperand(2).getUInt();
     unsigned addrSpace = memsetInst->getDestAddressSpace();
 
     TypedValue shadowValue = {size, 1, new unsigned char[size]};
@@ -1013,8 +1173,22 @@ void Uninitialized::hostMemoryStore(const Memory* memory, size_t address,
 {
   if (memory->getAddressSpace() == AddrSpaceGlobal)
   {
-    TypedValue v = ShadowContext::getCleanValue(size);
-    allocAndStoreShadowMemory(AddrSpaceGlobal, address, v);
+    ShadowMemory* shadowMemory = shadowContext.getGlobalMemory();
+    size_t bufferSize = memory->getBuffer(address)->size;
+
+    if (memory->extractOffset(address) == 0 && size == bufferSize)
+    {
+      // Whole buffer written, so every page starts out clean
+      shadowMemory->allocate(address, size, false);
+    }
+    else
+    {
+      if (!shadowMemory->isAddressValid(address, size))
+      {
+        shadowMemory->allocate(address, bufferSize);
+      }
+      shadowMemory->fill(address, size, false);
+    }
   }
 }
 
@@ -1071,7 +1245,7 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
     else
     {
       TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
-      TypedValue Shift = workItem->getOperand(instruction->getOperand(1));
+      TypedValue Shift = workItem->getCurrentOperand(1);
       uint64_t shiftMask =
         (S0.num > 1 ? S0.size : max((size_t)S0.size, sizeof(uint32_t))) * 8 - 1;
 
@@ -1138,8 +1312,7 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
 
     if (function->isDeclaration())
     {
-      if (!handleBuiltinFunction(workItem, function->getName().str(), callInst,
-                                 result))
+      if (!handleBuiltinFunction(workItem, function, callInst, result))
       {
         // Handle external function calls
         checkAllOperandsDefined(workItem, instruction);
@@ -1178,16 +1351,15 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
         assert(Val->getType()->isPointerTy() &&
                "ByVal argument is not a pointer!");
         // Make new copy of shadow in private memory
-        size_t origShadowAddress = workItem->getOperand(Val).getPointer();
+        size_t origShadowAddress =
+          workItem->getCurrentOperand(argItr->getArgNo()).getPointer();
         size_t newShadowAddress = workItem->getOperand(&*argItr).getPointer();
         ShadowMemory* mem = shadowWorkItem->getPrivateMemory();
-        unsigned char* origShadowData =
-          (unsigned char*)mem->getPointer(origShadowAddress);
         size_t size = getTypeSize(argItr->getParamByValType());
 
         // Set new shadow memory
         TypedValue v = ShadowContext::getCleanValue(size);
-        memcpy(v.data, origShadowData, size);
+        mem->load(v.data, origShadowAddress, size);
         allocAndStoreShadowMemory(AddrSpacePrivate, newShadowAddress, v,
                                   workItem);
         values->setValue(&*argItr, ShadowContext::getCleanValue(&*argItr));
@@ -1227,8 +1399,7 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
       shadowContext.getValue(workItem, extractInst->getVectorOperand());
     TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
 
-    unsigned index =
-      workItem->getOperand(extractInst->getIndexOperand()).getUInt();
+    unsigned index = workItem->getCurrentOperand(1).getUInt();
     memcpy(newShadow.data, vectorShadow.data + newShadow.size * index,
            newShadow.size);
 
@@ -1361,7 +1532,7 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
       shadowContext.getValue(workItem, instruction->getOperand(1));
     TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
 
-    unsigned index = workItem->getOperand(instruction->getOperand(2)).getUInt();
+    unsigned index = workItem->getCurrentOperand(2).getUInt();
     memcpy(newShadow.data, vectorShadow.data, newShadow.size * newShadow.num);
     memcpy(newShadow.data + index * newShadow.size, elementShadow.data,
            newShadow.size);
@@ -1433,7 +1604,7 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
     const llvm::LoadInst* loadInst = ((const llvm::LoadInst*)instruction);
     const llvm::Value* Addr = loadInst->getPointerOperand();
 
-    size_t address = workItem->getOperand(Addr).getPointer();
+    size_t address = workItem->getCurrentOperand(0).getPointer();
     unsigned addrSpace = loadInst->getPointerAddressSpace();
 
     TypedValue v = shadowContext.getMemoryPool()->clone(result);
@@ -1468,7 +1639,7 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
     else
     {
       TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
-      TypedValue Shift = workItem->getOperand(instruction->getOperand(1));
+      TypedValue Shift = workItem->getCurrentOperand(1);
       uint64_t shiftMask =
         (S0.num > 1 ? S0.size : max((size_t)S0.size, sizeof(uint32_t))) * 8 - 1;
 
@@ -1556,7 +1727,7 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
   {
     const llvm::SelectInst* selectInst = (const llvm::SelectInst*)instruction;
 
-    TypedValue opCondition = workItem->getOperand(selectInst->getCondition());
+    TypedValue opCondition = workItem->getCurrentOperand(0);
     TypedValue conditionShadow =
       shadowContext.getValue(workItem, selectInst->getCondition());
     TypedValue newShadow;
@@ -1621,7 +1792,7 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
     else
     {
       TypedValue newShadow = shadowContext.getMemoryPool()->clone(result);
-      TypedValue Shift = workItem->getOperand(instruction->getOperand(1));
+      TypedValue Shift = workItem->getCurrentOperand(1);
       uint64_t shiftMask =
         (S0.num > 1 ? S0.size : max((size_t)S0.size, sizeof(uint32_t))) * 8 - 1;
 
@@ -1693,7 +1864,7 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
     const llvm::Value* Val = storeInst->getValueOperand();
     const llvm::Value* Addr = storeInst->getPointerOperand();
 
-    size_t address = workItem->getOperand(Addr).getPointer();
+    size_t address = workItem->getCurrentOperand(1).getPointer();
     unsigned addrSpace = storeInst->getPointerAddressSpace();
 
     TypedValue shadowVal = storeInst->isAtomic()
@@ -1790,6 +1961,9 @@ void Uninitialized::instructionExecuted(const WorkItem* workItem,
 void Uninitialized::kernelBegin(const KernelInvocation* kernelInvocation)
 {
   const Kernel* kernel = kernelInvocation->getKernel();
+  shadowContext.setInterpreterCache(
+    kernel->getProgram()->getInterpreterCache(kernel->getFunction()));
+  resolveBuiltins(kernel->getFunction()->getParent());
 
   // Initialise kernel arguments and global variables
   for (auto value = kernel->values_begin(); value != kernel->values_end();
@@ -1831,9 +2005,7 @@ void Uninitialized::kernelBegin(const KernelInvocation* kernelInvocation)
         {
           // Allocate poisoned global memory if there was no host store
           size_t size = m_context->getGlobalMemory()->getBuffer(address)->size;
-          allocAndStoreShadowMemory(AddrSpaceGlobal, address,
-                                    ShadowContext::getPoisonedValue(size), NULL,
-                                    NULL, true);
+          shadowContext.getGlobalMemory()->allocate(address, size);
         }
 
         m_deferredInit.push_back(*value);
@@ -1901,6 +2073,7 @@ void Uninitialized::kernelBegin(const KernelInvocation* kernelInvocation)
 
 void Uninitialized::kernelEnd(const KernelInvocation* kernelInvocation)
 {
+  m_builtins.clear();
   m_deferredInit.clear();
   m_deferredInitGroup.clear();
   shadowContext.clearGlobalValues();
@@ -1981,6 +2154,26 @@ void Uninitialized::memoryMap(const Memory* memory, size_t address,
   }
 }
 
+void Uninitialized::resolveBuiltins(const llvm::Module* module)
+{
+  for (const llvm::Function& function : *module)
+  {
+    if (!function.isDeclaration())
+    {
+      continue;
+    }
+
+    Builtin builtin;
+    builtin.name =
+      extractUnmangledName(function.getName().str(), builtin.paramTypes);
+    builtin.handler = findBuiltinHandler(builtin.name);
+    if (builtin.handler)
+    {
+      m_builtins[&function] = builtin;
+    }
+  }
+}
+
 void Uninitialized::VectorOr(const WorkItem* workItem,
                              const llvm::Instruction* I)
 {
@@ -2026,7 +2219,7 @@ void Uninitialized::SimpleOrAtomic(const WorkItem* workItem,
 {
   const llvm::Value* Addr = CI->getArgOperand(0);
   unsigned addrSpace = Addr->getType()->getPointerAddressSpace();
-  size_t address = workItem->getOperand(Addr).getPointer();
+  size_t address = workItem->getCurrentOperand(0).getPointer();
 
   TypedValue oldShadow = {4, 1, shadowContext.getMemoryPool()->alloc(4)};
 
@@ -2106,7 +2299,6 @@ void Uninitialized::storeShadowMemory(unsigned addrSpace, size_t address,
 void Uninitialized::workItemBegin(const WorkItem* workItem)
 {
   shadowContext.createMemoryPool();
-  shadowContext.allocateWorkItems();
   ShadowWorkItem* shadowWI = shadowContext.createShadowWorkItem(workItem);
   ShadowValues* shadowValues = shadowWI->getValues();
 
@@ -2181,7 +2373,6 @@ void Uninitialized::workItemBegin(const WorkItem* workItem)
 void Uninitialized::workItemComplete(const WorkItem* workItem)
 {
   shadowContext.destroyShadowWorkItem(workItem);
-  shadowContext.freeWorkItems();
   shadowContext.destroyMemoryPool();
 }
 
@@ -2222,7 +2413,8 @@ void Uninitialized::workGroupComplete(const WorkGroup* workGroup)
   shadowContext.destroyMemoryPool();
 }
 
-ShadowFrame::ShadowFrame() : m_values(new UnorderedTypedValueMap())
+ShadowFrame::ShadowFrame(const WorkItem* workItem, unsigned numValues)
+    : m_call(NULL), m_workItem(workItem), m_values(numValues)
 {
 #ifdef DUMP_SHADOW
   m_valuesList = new ValuesList();
@@ -2231,12 +2423,24 @@ ShadowFrame::ShadowFrame() : m_values(new UnorderedTypedValueMap())
 
 ShadowFrame::~ShadowFrame()
 {
-  delete m_values;
 #ifdef DUMP_SHADOW
   delete m_valuesList;
 #endif
 }
 
+void ShadowFrame::clear()
+{
+  for (unsigned id : m_setValues)
+  {
+    m_values[id].num = 0;
+  }
+  m_setValues.clear();
+  m_call = NULL;
+#ifdef DUMP_SHADOW
+  m_valuesList->clear();
+#endif
+}
+
 void ShadowFrame::dump() const
 {
   cout << "==== ShadowMap (private) =======" << endl;
@@ -2249,12 +2453,12 @@ void ShadowFrame::dump() const
   {
     if ((*itr)->hasName())
     {
-      cout << "%" << (*itr)->getName().str() << ": " << m_values->at(*itr)
+      cout << "%" << (*itr)->getName().str() << ": " << getValue(*itr)
            << endl;
     }
     else
     {
-      cout << "%" << dec << num++ << ": " << m_values->at(*itr) << endl;
+      cout << "%" << dec << num++ << ": " << getValue(*itr) << endl;
     }
   }
 #else
@@ -2266,22 +2470,17 @@ void ShadowFrame::dump() const
 
 TypedValue ShadowFrame::getValue(const llvm::Value* V) const
 {
-  if (llvm::isa<llvm::Instruction>(V))
+  if (llvm::isa<llvm::Instruction>(V) || llvm::isa<llvm::Argument>(V))
   {
-    // For instructions the shadow is already stored in the map.
-    assert(m_values->count(V) && "No shadow for instruction value");
-    return m_values->at(V);
+    // For instructions and arguments the shadow is already stored.
+    const TypedValue& shadow = m_values[m_workItem->getValueID(V)];
+    assert(shadow.num && "No shadow for instruction or argument value");
+    return shadow;
   }
   else if (llvm::isa<llvm::UndefValue>(V))
   {
     return ShadowContext::getPoisonedValue(V);
   }
-  else if (llvm::isa<llvm::Argument>(V))
-  {
-    // For arguments the shadow is already stored in the map.
-    assert(m_values->count(V) && "No shadow for argument value");
-    return m_values->at(V);
-  }
   else if (const llvm::ConstantVector* VC =
              llvm::dyn_cast<llvm::ConstantVector>(V))
   {
@@ -2304,22 +2503,37 @@ TypedValue ShadowFrame::getValue(const llvm::Value* V) const
   }
 }
 
+bool ShadowFrame::hasValue(const llvm::Value* V) const
+{
+  if (llvm::isa<llvm::Instruction>(V) || llvm::isa<llvm::Argument>(V))
+  {
+    return m_values[m_workItem->getValueID(V)].num;
+  }
+  return llvm::isa<llvm::Constant>(V);
+}
+
 void ShadowFrame::setValue(const llvm::Value* V, TypedValue SV)
 {
-#ifdef DUMP_SHADOW
-  if (!m_values->count(V))
+  assert(SV.num && "Shadow values must not be empty");
+
+  TypedValue& shadow = m_values[m_workItem->getValueID(V)];
+  if (!shadow.num)
   {
+    m_setValues.push_back(m_workItem->getValueID(V));
+#ifdef DUMP_SHADOW
     m_valuesList->push_back(V);
   }
   else
   {
     cout << "Shadow for value " << V->getName().str() << " reset!" << endl;
-  }
 #endif
-  (*m_values)[V] = SV;
+  }
+  shadow = SV;
 }
 
-ShadowValues::ShadowValues() : m_stack(new ShadowValuesStack())
+ShadowValues::ShadowValues(const WorkItem* workItem, unsigned numValues)
+    : m_workItem(workItem), m_numValues(numValues),
+      m_stack(new ShadowValuesStack())
 {
   pushFrame(createCleanShadowFrame());
 }
@@ -2331,17 +2545,30 @@ ShadowValues::~ShadowValues()
     popFrame();
   }
 
+  for (ShadowFrame* frame : m_freeFrames)
+  {
+    delete frame;
+  }
+
   delete m_stack;
 }
 
 ShadowFrame* ShadowValues::createCleanShadowFrame()
 {
-  return new ShadowFrame();
+  if (m_freeFrames.empty())
+  {
+    return new ShadowFrame(m_workItem, m_numValues);
+  }
+
+  ShadowFrame* frame = m_freeFrames.back();
+  m_freeFrames.pop_back();
+  return frame;
 }
 
-ShadowWorkItem::ShadowWorkItem(unsigned bufferBits)
+ShadowWorkItem::ShadowWorkItem(const WorkItem* workItem, unsigned bufferBits,
+                               unsigned numValues)
     : m_memory(new ShadowMemory(AddrSpacePrivate, bufferBits)),
-      m_values(new ShadowValues())
+      m_values(new ShadowValues(workItem, numValues))
 {
 }
 
@@ -2351,9 +2578,10 @@ ShadowWorkItem::~ShadowWorkItem()
   delete m_values;
 }
 
-ShadowWorkGroup::ShadowWorkGroup(unsigned bufferBits)
+ShadowWorkGroup::ShadowWorkGroup(unsigned bufferBits, size_t numWorkItems)
     : // FIXME: Hard coded values
-      m_memory(new ShadowMemory(AddrSpaceLocal, sizeof(size_t) == 8 ? 16 : 8))
+      m_memory(new ShadowMemory(AddrSpaceLocal, sizeof(size_t) == 8 ? 16 : 8)),
+      m_workItems(numWorkItems, NULL)
 {
 }
 
@@ -2374,7 +2602,7 @@ ShadowMemory::~ShadowMemory()
   clear();
 }
 
-void ShadowMemory::allocate(size_t address, size_t size)
+void ShadowMemory::allocate(size_t address, size_t size, bool poisoned)
 {
   size_t index = extractBuffer(address);
 
@@ -2383,10 +2611,17 @@ void ShadowMemory::allocate(size_t address, size_t size)
     deallocate(address);
   }
 
+  size_t numPages = (size + SHADOW_PAGE_SIZE - 1) / SHADOW_PAGE_SIZE;
+
   Buffer* buffer = new Buffer();
   buffer->size = size;
   buffer->flags = 0;
-  buffer->data = new unsigned char[size];
+  buffer->pages = new Page[numPages];
+  for (size_t p = 0; p < numPages; p++)
+  {
+    buffer->pages[p].state = poisoned ? POISONED_PAGE : CLEAN_PAGE;
+    buffer->pages[p].data = NULL;
+  }
 
   m_map[index] = buffer;
 }
@@ -2396,9 +2631,9 @@ void ShadowMemory::clear()
   MemoryMap::iterator mItr;
   for (mItr = m_map.begin(); mItr != m_map.end(); ++mItr)
   {
-    delete[] mItr->second->data;
-    delete mItr->second;
+    deallocate(mItr->first << m_numBitsAddress);
   }
+  m_map.clear();
 }
 
 void ShadowMemory::deallocate(size_t address)
@@ -2407,8 +2642,19 @@ void ShadowMemory::deallocate(size_t address)
 
   assert(m_map.count(index) && "Cannot deallocate non existing memory!");
 
-  delete[] m_map.at(index)->data;
-  delete m_map.at(index);
+  Buffer* buffer = m_map.at(index);
+  if (!buffer)
+  {
+    return;
+  }
+
+  size_t numPages = (buffer->size + SHADOW_PAGE_SIZE - 1) / SHADOW_PAGE_SIZE;
+  for (size_t p = 0; p < numPages; p++)
+  {
+    delete[] buffer->pages[p].data;
+  }
+  delete[] buffer->pages;
+  delete buffer;
   m_map.at(index) = NULL;
 }
 
@@ -2424,16 +2670,20 @@ void ShadowMemory::dump() const
       continue;
     }
 
+    size_t base = ((size_t)b + o) << m_numBitsAddress;
     for (unsigned i = 0; i < m_map.at(b + o)->size; i++)
     {
       if (i % 4 == 0)
       {
         cout << endl
              << hex << uppercase << setw(16) << setfill(' ') << right
-             << ((((size_t)b + o) << m_numBitsAddress) | i) << ":";
+             << (base | i) << ":";
       }
+
+      unsigned char shadow;
+      load(&shadow, base | i);
       cout << " " << hex << uppercase << setw(2) << setfill('0')
-           << (int)m_map.at(b + o)->data[i];
+           << (int)shadow;
     }
 
     ++b;
@@ -2454,21 +2704,33 @@ size_t ShadowMemory::extractOffset(size_t address) const
   return (address & (((size_t)-1) >> m_numBitsBuffer));
 }
 
-void* ShadowMemory::getPointer(size_t address) const
+void ShadowMemory::fill(size_t address, size_t size, bool poisoned)
 {
   size_t index = extractBuffer(address);
   size_t offset = extractOffset(address);
 
-  assert(m_map.count(index) && "No shadow memory found!");
-
-  return m_map.at(index)->data + offset;
+  if (isAddressValid(address, size))
+  {
+    uint8_t state = poisoned ? POISONED_PAGE : CLEAN_PAGE;
+    while (size)
+    {
+      size_t page = offset / SHADOW_PAGE_SIZE;
+      size_t pageOffset = offset % SHADOW_PAGE_SIZE;
+      size_t num = min<size_t>(size, SHADOW_PAGE_SIZE - pageOffset);
+      storePage(NULL, state, index, page, pageOffset, num);
+      offset += num;
+      size -= num;
+    }
+  }
 }
 
 bool ShadowMemory::isAddressValid(size_t address, size_t size) const
 {
   size_t index = extractBuffer(address);
   size_t offset = extractOffset(address);
-  return m_map.count(index) && (offset + size <= m_map.at(index)->size);
+  MemoryMap::const_iterator itr = m_map.find(index);
+  return itr != m_map.end() && itr->second &&
+         (offset + size <= itr->second->size);
 }
 
 void ShadowMemory::load(unsigned char* dst, size_t address, size_t size) const
@@ -2478,8 +2740,16 @@ void ShadowMemory::load(unsigned char* dst, size_t address, size_t size) const
 
   if (isAddressValid(address, size))
   {
-    assert(m_map.count(index) && "No shadow memory found!");
-    memcpy(dst, m_map.at(index)->data + offset, size);
+    while (size)
+    {
+      size_t page = offset / SHADOW_PAGE_SIZE;
+      size_t pageOffset = offset % SHADOW_PAGE_SIZE;
+      size_t num = min<size_t>(size, SHADOW_PAGE_SIZE - pageOffset);
+      loadPage(dst, index, page, pageOffset, num);
+      dst += num;
+      offset += num;
+      size -= num;
+    }
   }
   else
   {
@@ -2488,6 +2758,47 @@ void ShadowMemory::load(unsigned char* dst, size_t address, size_t size) const
   }
 }
 
+void ShadowMemory::loadPage(unsigned char* dst, size_t index, size_t page,
+                            size_t offset, size_t size) const
+{
+  const Page& p = m_map.at(index)->pages[page];
+
+  // Uniform pages can be read without synchronisation
+  uint8_t state = p.state.load(memory_order_acquire);
+  if (state == CLEAN_PAGE || state == POISONED_PAGE)
+  {
+    memset(dst, state == CLEAN_PAGE ? 0 : 0xFF, size);
+    return;
+  }
+
+  unique_lock<mutex> lock;
+  if (m_addrSpace == AddrSpaceGlobal)
+  {
+    lock = unique_lock<mutex>(PAGE_MUTEX(index, page));
+    state = p.state.load(memory_order_relaxed);
+  }
+
+  switch (state)
+  {
+  case CLEAN_PAGE:
+    memset(dst, 0, size);
+    break;
+  case POISONED_PAGE:
+    memset(dst, 0xFF, size);
+    break;
+  case MASK_PAGE:
+    for (size_t i = 0; i < size; i++)
+    {
+      size_t bit = offset + i;
+      dst[i] = ((p.data[bit >> 3] >> (bit & 7)) & 1) ? 0xFF : 0;
+    }
+    break;
+  case BYTE_PAGE:
+    memcpy(dst, p.data + offset, size);
+    break;
+  }
+}
+
 void ShadowMemory::lock(size_t address) const
 {
   size_t offset = extractOffset(address);
@@ -2501,9 +2812,124 @@ void ShadowMemory::store(const unsigned char* src, size_t address, size_t size)
 
   if (isAddressValid(address, size))
   {
-    assert(m_map.count(index) && "Cannot store to unallocated memory!");
-    memcpy(m_map.at(index)->data + offset, src, size);
+    while (size)
+    {
+      size_t page = offset / SHADOW_PAGE_SIZE;
+      size_t pageOffset = offset % SHADOW_PAGE_SIZE;
+      size_t num = min<size_t>(size, SHADOW_PAGE_SIZE - pageOffset);
+
+      // Find the most compact representation that can hold the data
+      bool clean = true, poisoned = true;
+      size_t i;
+      for (i = 0; i < num; i++)
+      {
+        if (src[i] == 0)
+          poisoned = false;
+        else if (src[i] == 0xFF)
+          clean = false;
+        else
+          break;
+      }
+
+      uint8_t state = MASK_PAGE;
+      if (i < num)
+        state = BYTE_PAGE;
+      else if (clean)
+        state = CLEAN_PAGE;
+      else if (poisoned)
+        state = POISONED_PAGE;
+
+      storePage(src, state, index, page, pageOffset, num);
+      src += num;
+      offset += num;
+      size -= num;
+    }
+  }
+}
+
+void ShadowMemory::storePage(const unsigned char* src, uint8_t state,
+                             size_t index, size_t page, size_t offset,
+                             size_t size)
+{
+  Buffer* buffer = m_map.at(index);
+  Page& p = buffer->pages[page];
+  size_t pageSize =
+    min<size_t>(buffer->size - page * SHADOW_PAGE_SIZE, SHADOW_PAGE_SIZE);
+  bool uniform = state == CLEAN_PAGE || state == POISONED_PAGE;
+
+  // Storing uniform data to a page already in that state is a no-op
+  if (uniform && p.state.load(memory_order_acquire) == state)
+  {
+    return;
+  }
+
+  unique_lock<mutex> lock;
+  if (m_addrSpace == AddrSpaceGlobal)
+  {
+    lock = unique_lock<mutex>(PAGE_MUTEX(index, page));
+  }
+
+  uint8_t current = p.state.load(memory_order_relaxed);
+  if (uniform && (current == state || size == pageSize))
+  {
+    // Whole page overwritten, so drop any backing storage
+    delete[] p.data;
+    p.data = NULL;
+    p.state.store(state, memory_order_release);
+    return;
+  }
+
+  // Materialise backing storage if necessary
+  if (current == CLEAN_PAGE || current == POISONED_PAGE)
+  {
+    int fill = current == CLEAN_PAGE ? 0 : 0xFF;
+    if (state == BYTE_PAGE)
+    {
+      p.data = new unsigned char[pageSize];
+      memset(p.data, fill, pageSize);
+      current = BYTE_PAGE;
+    }
+    else
+    {
+      p.data = new unsigned char[(pageSize + 7) / 8];
+      memset(p.data, fill, (pageSize + 7) / 8);
+      current = MASK_PAGE;
+    }
+  }
+  else if (current == MASK_PAGE && state == BYTE_PAGE)
+  {
+    unsigned char* bytes = new unsigned char[pageSize];
+    for (size_t i = 0; i < pageSize; i++)
+    {
+      bytes[i] = ((p.data[i >> 3] >> (i & 7)) & 1) ? 0xFF : 0;
+    }
+    delete[] p.data;
+    p.data = bytes;
+    current = BYTE_PAGE;
+  }
+
+  if (current == MASK_PAGE)
+  {
+    for (size_t i = 0; i < size; i++)
+    {
+      size_t bit = offset + i;
+      bool poison = uniform ? state == POISONED_PAGE : src[i] != 0;
+      if (poison)
+        p.data[bit >> 3] |= (1 << (bit & 7));
+      else
+        p.data[bit >> 3] &= ~(1 << (bit & 7));
+    }
+  }
+  else if (uniform)
+  {
+    memset(p.data + offset, state == CLEAN_PAGE ? 0 : 0xFF, size);
   }
+  else
+  {
+    memcpy(p.data + offset, src, size);
+  }
+
+  p.state.store(current, memory_order_release);
 }
 
 void ShadowMemory::unlock(size_t address) const
@@ -2513,8 +2939,9 @@ void ShadowMemory::unlock(size_t address) const
 }
 
 ShadowContext::ShadowContext(unsigned bufferBits)
-    : m_globalMemory(new ShadowMemory(AddrSpaceGlobal, bufferBits)),
-      m_globalValues(), m_numBitsBuffer(bufferBits)
+    : m_cache(NULL),
+      m_globalMemory(new ShadowMemory(AddrSpaceGlobal, bufferBits)),
+      m_numBitsBuffer(bufferBits)
 {
 }
 
@@ -2523,14 +2950,6 @@ ShadowContext::~ShadowContext()
   delete m_globalMemory;
 }
 
-void ShadowContext::allocateWorkItems()
-{
-  if (!m_workSpace.workItems)
-  {
-    m_workSpace.workItems = new ShadowItemMap();
-  }
-}
-
 void ShadowContext::allocateWorkGroups()
 {
   if (!m_workSpace.workGroups)
@@ -2542,6 +2961,7 @@ void ShadowContext::allocateWorkGroups()
 void ShadowContext::clearGlobalValues()
 {
   m_globalValues.clear();
+  m_cache = NULL;
 }
 
 void ShadowContext::createMemoryPool()
@@ -2556,10 +2976,12 @@ void ShadowContext::createMemoryPool()
 
 ShadowWorkItem* ShadowContext::createShadowWorkItem(const WorkItem* workItem)
 {
-  assert(!m_workSpace.workItems->count(workItem) &&
-         "Workitems may only have one shadow");
-  ShadowWorkItem* sWI = new ShadowWorkItem(m_numBitsBuffer);
-  (*m_workSpace.workItems)[workItem] = sWI;
+  ShadowWorkGroup* sWG = getShadowWorkGroup(workItem->getWorkGroup());
+  size_t index = getLocalIndex(workItem);
+  assert(!sWG->getWorkItem(index) && "Workitems may only have one shadow");
+  ShadowWorkItem* sWI =
+    new ShadowWorkItem(workItem, m_numBitsBuffer, m_globalValues.size());
+  sWG->setWorkItem(index, sWI);
   return sWI;
 }
 
@@ -2568,7 +2990,9 @@ ShadowContext::createShadowWorkGroup(const WorkGroup* workGroup)
 {
   assert(!m_workSpace.workGroups->count(workGroup) &&
          "Workgroups may only have one shadow");
-  ShadowWorkGroup* sWG = new ShadowWorkGroup(m_numBitsBuffer);
+  Size3 groupSize = workGroup->getGroupSize();
+  ShadowWorkGroup* sWG = new ShadowWorkGroup(
+    m_numBitsBuffer, groupSize.x * groupSize.y * groupSize.z);
   (*m_workSpace.workGroups)[workGroup] = sWG;
   return sWG;
 }
@@ -2585,10 +3009,11 @@ void ShadowContext::destroyMemoryPool()
 
 void ShadowContext::destroyShadowWorkItem(const WorkItem* workItem)
 {
-  assert(m_workSpace.workItems->count(workItem) &&
-         "No shadow for workitem found!");
-  delete (*m_workSpace.workItems)[workItem];
-  m_workSpace.workItems->erase(workItem);
+  ShadowWorkGroup* sWG = getShadowWorkGroup(workItem->getWorkGroup());
+  size_t index = getLocalIndex(workItem);
+  assert(sWG->getWorkItem(index) && "No shadow for workitem found!");
+  delete sWG->getWorkItem(index);
+  sWG->setWorkItem(index, NULL);
 }
 
 void ShadowContext::destroyShadowWorkGroup(const WorkGroup* workGroup)
@@ -2597,6 +3022,12 @@ void ShadowContext::destroyShadowWorkGroup(const WorkGroup* workGroup)
          "No shadow for workgroup found!");
   delete (*m_workSpace.workGroups)[workGroup];
   m_workSpace.workGroups->erase(workGroup);
+
+  if (m_workSpace.lastWorkGroup == workGroup)
+  {
+    m_workSpace.lastWorkGroup = NULL;
+    m_workSpace.lastShadowWorkGroup = NULL;
+  }
 }
 
 void ShadowContext::dump(const WorkItem* workItem) const
@@ -2607,21 +3038,26 @@ void ShadowContext::dump(const WorkItem* workItem) const
   {
     m_workSpace.workGroups->begin()->second->dump();
   }
-  if (m_workSpace.workItems && m_workSpace.workItems->size())
+  if (workItem)
   {
-    if (workItem)
-    {
-      cout << "Item " << workItem->getGlobalID() << endl;
-      getShadowWorkItem(workItem)->dump();
-    }
-    else
+    cout << "Item " << workItem->getGlobalID() << endl;
+    getShadowWorkItem(workItem)->dump();
+  }
+  else if (m_workSpace.workGroups)
+  {
+    ShadowGroupMap::const_iterator itr;
+    for (itr = m_workSpace.workGroups->begin();
+         itr != m_workSpace.workGroups->end(); ++itr)
     {
-      ShadowItemMap::const_iterator itr;
-      for (itr = m_workSpace.workItems->begin();
-           itr != m_workSpace.workItems->end(); ++itr)
+      for (size_t i = 0; i < itr->second->getNumWorkItems(); i++)
       {
-        cout << "Item " << itr->first->getGlobalID() << endl;
-        itr->second->dump();
+        ShadowWorkItem* sWI = itr->second->getWorkItem(i);
+        if (sWI)
+        {
+          cout << "Local item " << Size3(i, itr->first->getGroupSize())
+               << endl;
+          sWI->dump();
+        }
       }
     }
   }
@@ -2631,33 +3067,17 @@ void ShadowContext::dumpGlobalValues() const
 {
   cout << "==== ShadowMap (global) =======" << endl;
 
-  UnorderedTypedValueMap::const_iterator itr;
-  unsigned num = 1;
-
-  for (itr = m_globalValues.begin(); itr != m_globalValues.end(); ++itr)
+  for (unsigned id = 0; id < m_globalValues.size(); ++id)
   {
-    if (itr->first->hasName())
-    {
-      cout << "%" << itr->first->getName().str() << ": " << itr->second << endl;
-    }
-    else
+    if (m_globalValues[id].num)
     {
-      cout << "%" << dec << num++ << ": " << itr->second << endl;
+      cout << "%" << dec << id << ": " << m_globalValues[id] << endl;
     }
   }
 
   cout << "=======================" << endl;
 }
 
-void ShadowContext::freeWorkItems()
-{
-  if (m_workSpace.workItems && !m_workSpace.workItems->size())
-  {
-    delete m_workSpace.workItems;
-    m_workSpace.workItems = NULL;
-  }
-}
-
 void ShadowContext::freeWorkGroups()
 {
   if (m_workSpace.workGroups && !m_workSpace.workGroups->size())
@@ -2745,18 +3165,56 @@ TypedValue ShadowContext::getPoisonedValue(const llvm::Type* Ty)
   return v;
 }
 
+ShadowWorkItem*
+ShadowContext::getShadowWorkItem(const WorkItem* workItem) const
+{
+  return getShadowWorkGroup(workItem->getWorkGroup())
+    ->getWorkItem(getLocalIndex(workItem));
+}
+
+ShadowWorkGroup*
+ShadowContext::getShadowWorkGroup(const WorkGroup* workGroup) const
+{
+  // Consecutive lookups are usually for the same work-group
+  if (workGroup != m_workSpace.lastWorkGroup)
+  {
+    m_workSpace.lastShadowWorkGroup = m_workSpace.workGroups->at(workGroup);
+    m_workSpace.lastWorkGroup = workGroup;
+  }
+  return m_workSpace.lastShadowWorkGroup;
+}
+
 TypedValue ShadowContext::getValue(const WorkItem* workItem,
                                    const llvm::Value* V) const
 {
-  if (m_globalValues.count(V))
+  if (llvm::isa<llvm::Argument>(V) || llvm::isa<llvm::GlobalVariable>(V))
+  {
+    const TypedValue& shadow = m_globalValues[workItem->getValueID(V)];
+    if (shadow.num)
+    {
+      return shadow;
+    }
+  }
+
+  ShadowValues* shadowValues = getShadowWorkItem(workItem)->getValues();
+  return shadowValues->getValue(V);
+}
+
+bool ShadowContext::hasValue(const WorkItem* workItem,
+                             const llvm::Value* V) const
+{
+  if (llvm::isa<llvm::Constant>(V))
   {
-    return m_globalValues.at(V);
+    return true;
   }
-  else
+
+  if (llvm::isa<llvm::Argument>(V) &&
+      m_globalValues[workItem->getValueID(V)].num)
   {
-    ShadowValues* shadowValues = getShadowWorkItem(workItem)->getValues();
-    return shadowValues->getValue(V);
+    return true;
   }
+
+  return getShadowWorkItem(workItem)->getValues()->hasValue(V);
 }
 
 bool ShadowContext::isCleanImage(const TypedValue shadowImage)
@@ -2859,8 +3317,17 @@ bool ShadowContext::isCleanValue(TypedValue v, unsigned offset)
 
 void ShadowContext::setGlobalValue(const llvm::Value* V, TypedValue SV)
 {
-  assert(!m_globalValues.count(V) && "Values may only have one shadow");
-  m_globalValues[V] = SV;
+  TypedValue& shadow = m_globalValues[m_cache->getValueID(V)];
+  assert(!shadow.num && "Values may only have one shadow");
+  shadow = SV;
+}
+
+void ShadowContext::setInterpreterCache(const InterpreterCache* cache)
+{
+  m_cache = cache;
+
+  TypedValue unset = {0, 0, NULL};
+  m_globalValues.assign(cache->getNumValues(), unset);
 }
 
 void ShadowContext::shadowOr(TypedValue v1, TypedValue v2)
@@ -10,6 +10,8 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IntrinsicInst.h"
 
+#include <atomic>
+
 // #define DUMP_SHADOW
 // #define PARANOID_CHECK(W, I) assert(checkAllOperandsDefined(W, I) && "Not all
 //  operands defined") #define PARANOID_CHECK(W, I) checkAllOperandsDefined(W,
@@ -18,25 +20,22 @@
 
 namespace oclgrind
 {
-typedef std::unordered_map<const llvm::Value*, TypedValue>
-  UnorderedTypedValueMap;
+class InterpreterCache;
 
 class ShadowFrame
 {
 public:
-  ShadowFrame();
+  ShadowFrame(const WorkItem* workItem, unsigned numValues);
   virtual ~ShadowFrame();
 
+  void clear();
   void dump() const;
   inline const llvm::CallInst* getCall() const
   {
     return m_call;
   }
   TypedValue getValue(const llvm::Value* V) const;
-  inline bool hasValue(const llvm::Value* V) const
-  {
-    return llvm::isa<llvm::Constant>(V) || m_values->count(V);
-  }
+  bool hasValue(const llvm::Value* V) const;
   inline void setCall(const llvm::CallInst* CI)
   {
     m_call = CI;
@@ -47,7 +46,12 @@ private:
   typedef std::list<const llvm::Value*> ValuesList;
 
   const llvm::CallInst* m_call;
-  UnorderedTypedValueMap* m_values;
+  const WorkItem* m_workItem;
+
+  // Shadows indexed by value ID (unset entries have num == 0), and the IDs
+  // that have been set so that the frame can be cleared cheaply
+  std::vector<TypedValue> m_values;
+  std::vector<unsigned> m_setValues;
 #ifdef DUMP_SHADOW
   ValuesList* m_valuesList;
 #endif
@@ -56,7 +60,7 @@ private:
 class ShadowValues
 {
 public:
-  ShadowValues();
+  ShadowValues(const WorkItem* workItem, unsigned numValues);
   virtual ~ShadowValues();
 
   ShadowFrame* createCleanShadowFrame();
@@ -80,7 +84,8 @@ public:
   {
     ShadowFrame* frame = m_stack->top();
     m_stack->pop();
-    delete frame;
+    frame->clear();
+    m_freeFrames.push_back(frame);
   }
   inline void pushFrame(ShadowFrame* frame)
   {
@@ -98,25 +103,45 @@ public:
 private:
   typedef std::stack<ShadowFrame*> ShadowValuesStack;
 
+  const WorkItem* m_workItem;
+  unsigned m_numValues;
   ShadowValuesStack* m_stack;
+
+  // Frames are recycled between calls to avoid reallocating value arrays
+  std::vector<ShadowFrame*> m_freeFrames;
 };
 
 class ShadowMemory
 {
 public:
+  // Pages that are entirely clean or poisoned have no backing storage.
+  // Otherwise a page holds a poison mask with one bit per byte, or the
+  // exact shadow bytes once some byte is only partially poisoned.
+  enum PageState
+  {
+    CLEAN_PAGE,
+    POISONED_PAGE,
+    MASK_PAGE,
+    BYTE_PAGE
+  };
+  struct Page
+  {
+    std::atomic<uint8_t> state;
+    unsigned char* data;
+  };
   struct Buffer
   {
     size_t size;
     cl_mem_flags flags;
-    unsigned char* data;
+    Page* pages;
   };
 
   ShadowMemory(AddressSpace addrSpace, unsigned bufferBits);
   virtual ~ShadowMemory();
 
-  void allocate(size_t address, size_t size);
+  void allocate(size_t address, size_t size, bool poisoned = true);
   void dump() const;
-  void* getPointer(size_t address) const;
+  void fill(size_t address, size_t size, bool poisoned);
   bool isAddressValid(size_t address, size_t size = 1) const;
   void load(unsigned char* dst, size_t address, size_t size = 1) const;
   void lock(size_t address) const;
@@ -126,6 +151,8 @@ public:
 private:
   typedef std::unordered_map<size_t, Buffer*> MemoryMap;
 
+  static const unsigned SHADOW_PAGE_SIZE = 4096;
+
   AddressSpace m_addrSpace;
   MemoryMap m_map;
   unsigned m_numBitsAddress;
@@ -135,12 +162,17 @@ private:
   void deallocate(size_t address);
   size_t extractBuffer(size_t address) const;
   size_t extractOffset(size_t address) const;
+  void loadPage(unsigned char* dst, size_t index, size_t page, size_t offset,
+                size_t size) const;
+  void storePage(const unsigned char* src, uint8_t state, size_t index,
+                 size_t page, size_t offset, size_t size);
 };
 
 class ShadowWorkItem
 {
 public:
-  ShadowWorkItem(unsigned bufferBits);
+  ShadowWorkItem(const WorkItem* workItem, unsigned bufferBits,
+                 unsigned numValues);
   virtual ~ShadowWorkItem();
 
   inline void dump() const
@@ -165,7 +197,7 @@ private:
 class ShadowWorkGroup
 {
 public:
-  ShadowWorkGroup(unsigned bufferBits);
+  ShadowWorkGroup(unsigned bufferBits, size_t numWorkItems);
   virtual ~ShadowWorkGroup();
 
   inline void dump() const
@@ -176,9 +208,24 @@ public:
   {
     return m_memory;
   }
+  inline size_t getNumWorkItems() const
+  {
+    return m_workItems.size();
+  }
+  inline ShadowWorkItem* getWorkItem(size_t index) const
+  {
+    return m_workItems[index];
+  }
+  inline void setWorkItem(size_t index, ShadowWorkItem* workItem)
+  {
+    m_workItems[index] = workItem;
+  }
 
 private:
   ShadowMemory* m_memory;
+
+  // Work-item shadows, indexed by local linear ID
+  std::vector<ShadowWorkItem*> m_workItems;
 };
 
 class ShadowContext
@@ -187,7 +234,6 @@ public:
   ShadowContext(unsigned bufferBits);
   virtual ~ShadowContext();
 
-  void allocateWorkItems();
   void allocateWorkGroups();
   void clearGlobalValues();
   void createMemoryPool();
@@ -198,7 +244,6 @@ public:
   void destroyShadowWorkGroup(const WorkGroup* workGroup);
   void dump(const WorkItem* workItem) const;
   void dumpGlobalValues() const;
-  void freeWorkItems();
   void freeWorkGroups();
   static TypedValue getCleanValue(unsigned size);
   static TypedValue getCleanValue(TypedValue v);
@@ -208,7 +253,6 @@ public:
   {
     return m_globalMemory;
   }
-  TypedValue getGlobalValue(const llvm::Value* V) const;
   MemoryPool* getMemoryPool() const
   {
     return m_workSpace.memoryPool;
@@ -217,20 +261,10 @@ public:
   static TypedValue getPoisonedValue(TypedValue v);
   static TypedValue getPoisonedValue(const llvm::Type* Ty);
   static TypedValue getPoisonedValue(const llvm::Value* V);
-  inline ShadowWorkItem* getShadowWorkItem(const WorkItem* workItem) const
-  {
-    return m_workSpace.workItems->at(workItem);
-  }
-  inline ShadowWorkGroup* getShadowWorkGroup(const WorkGroup* workGroup) const
-  {
-    return m_workSpace.workGroups->at(workGroup);
-  }
+  ShadowWorkItem* getShadowWorkItem(const WorkItem* workItem) const;
+  ShadowWorkGroup* getShadowWorkGroup(const WorkGroup* workGroup) const;
   TypedValue getValue(const WorkItem* workItem, const llvm::Value* V) const;
-  inline bool hasValue(const WorkItem* workItem, const llvm::Value* V) const
-  {
-    return llvm::isa<llvm::Constant>(V) || m_globalValues.count(V) ||
-           m_workSpace.workItems->at(workItem)->getValues()->hasValue(V);
-  }
+  bool hasValue(const WorkItem* workItem, const llvm::Value* V) const;
   static bool isCleanImage(const TypedValue shadowImage);
   static bool isCleanImageAddress(const TypedValue shadowImage);
   static bool isCleanImageDescription(const TypedValue shadowImage);
@@ -241,18 +275,23 @@ public:
   static bool isCleanValue(TypedValue v);
   static bool isCleanValue(TypedValue v, unsigned offset);
   void setGlobalValue(const llvm::Value* V, TypedValue SV);
+  void setInterpreterCache(const InterpreterCache* cache);
   static void shadowOr(TypedValue v1, TypedValue v2);
 
 private:
+  const InterpreterCache* m_cache;
   ShadowMemory* m_globalMemory;
-  UnorderedTypedValueMap m_globalValues;
   unsigned m_numBitsBuffer;
-  typedef std::map<const WorkItem*, ShadowWorkItem*> ShadowItemMap;
+
+  // Shadows of kernel arguments and global variables, indexed by value ID
+  std::vector<TypedValue> m_globalValues;
+
   typedef std::map<const WorkGroup*, ShadowWorkGroup*> ShadowGroupMap;
   struct WorkSpace
   {
-    ShadowItemMap* workItems;
     ShadowGroupMap* workGroups;
+    const WorkGroup* lastWorkGroup;
+    ShadowWorkGroup* lastShadowWorkGroup;
     MemoryPool* memoryPool;
     unsigned poolUsers;
   };
@@ -278,10 +317,27 @@ public:
   virtual void workItemComplete(const WorkItem* workItem) override;
   virtual void workGroupBegin(const WorkGroup* workGroup) override;
   virtual void workGroupComplete(const WorkGroup* workGroup) override;
+
+  virtual Subscription getSubscribedEvents() const override;
+
   // virtual void memoryAllocated(const Memory *memory, size_t address,
   //                             size_t size, cl_mem_flags flags,
   //                             const uint8_t *initData);
 private:
+  // Builtin function handlers, resolved once per callee at kernel launch
+  struct Builtin;
+  typedef void (Uninitialized::*BuiltinHandler)(const WorkItem* workItem,
+                                                const llvm::CallInst* CI,
+                                                const Builtin& builtin,
+                                                const TypedValue& result);
+  struct Builtin
+  {
+    BuiltinHandler handler;
+    std::string name, paramTypes;
+  };
+  typedef std::unordered_map<const llvm::Function*, Builtin> BuiltinMap;
+
+  BuiltinMap m_builtins;
   std::list<std::pair<const llvm::Value*, TypedValue>> m_deferredInit;
   std::list<std::pair<const llvm::Value*, TypedValue>> m_deferredInitGroup;
   ShadowContext shadowContext;
@@ -306,10 +362,12 @@ private:
                                bool unchecked = false);
   static std::string extractUnmangledName(const std::string fullname,
                                           std::string& paramTypes);
+  static BuiltinHandler findBuiltinHandler(const std::string& name);
   ShadowMemory* getShadowMemory(unsigned addrSpace,
                                 const WorkItem* workItem = NULL,
                                 const WorkGroup* workGroup = NULL) const;
-  bool handleBuiltinFunction(const WorkItem* workItem, std::string name,
+  bool handleBuiltinFunction(const WorkItem* workItem,
+                             const llvm::Function* function,
                              const llvm::CallInst* CI, const TypedValue result);
   void handleIntrinsicInstruction(const WorkItem* workItem,
                                   const llvm::IntrinsicInst* I);
@@ -321,6 +379,7 @@ private:
   void logUninitializedCF() const;
   void logUninitializedIndex() const;
   void logUninitializedWrite(unsigned int addrSpace, size_t address) const;
+  void resolveBuiltins(const llvm::Module* module);
   void SimpleOr(const WorkItem* workItem, const llvm::Instruction* I);
   void SimpleOrAtomic(const WorkItem* workItem, const llvm::CallInst* CI);
   void storeShadowMemory(unsigned addrSpace, size_t address, TypedValue SM,
@@ -328,5 +387,28 @@ private:
                          const WorkGroup* workGroup = NULL,
                          bool unchecked = false);
   void VectorOr(const WorkItem* workItem, const llvm::Instruction* I);
+
+  // Builtin function handlers
+#define BUILTIN_HANDLER(name)                                                  \
+  void name(const WorkItem* workItem, const llvm::CallInst* CI,                \
+            const Builtin& builtin, const TypedValue& result)
+  BUILTIN_HANDLER(handleAny);
+  BUILTIN_HANDLER(handleAsyncCopy);
+  BUILTIN_HANDLER(handleAtomic);
+  BUILTIN_HANDLER(handleFract);
+  BUILTIN_HANDLER(handleFrexp);
+  BUILTIN_HANDLER(handleGetImageInfo);
+  BUILTIN_HANDLER(handleReadImage);
+  BUILTIN_HANDLER(handleRemquo);
+  BUILTIN_HANDLER(handleSelect);
+  BUILTIN_HANDLER(handleShuffle);
+  BUILTIN_HANDLER(handleShuffle2);
+  BUILTIN_HANDLER(handleVload);
+  BUILTIN_HANDLER(handleVloadHalf);
+  BUILTIN_HANDLER(handleVstore);
+  BUILTIN_HANDLER(handleVstoreHalf);
+  BUILTIN_HANDLER(handleWaitGroupEvents);
+  BUILTIN_HANDLER(handleWriteImage);
+#undef BUILTIN_HANDLER
 };
 } // namespace oclgrind
@@ -196,7 +196,15 @@ static bool parseArguments(int argc, char* argv[])
 {
   for (int i = 1; i < argc; i++)
   {
-    if (!strcmp(argv[i], "--build-options"))
+    if (!strcmp(argv[i], "--array-checks"))
+    {
+      setEnvironment("OCLGRIND_ARRAY_CHECKS", "1");
+    }
+    else if (!strcmp(argv[i], "--bank-conflicts"))
+    {
+      setEnvironment("OCLGRIND_BANK_CONFLICTS", "1");
+    }
+    else if (!strcmp(argv[i], "--build-options"))
     {
       if (++i >= argc)
       {
@@ -205,6 +213,19 @@ static bool parseArguments(int argc, char* argv[])
       }
       setEnvironment("OCLGRIND_BUILD_OPTIONS", argv[i]);
     }
+    else if (!strcmp(argv[i], "--cache-line-size"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --cache-line-size" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_CACHE_LINE_SIZE", argv[i]);
+    }
+    else if (!strcmp(argv[i], "--cache-sim"))
+    {
+      setEnvironment("OCLGRIND_CACHE_SIM", "1");
+    }
     else if (!strcmp(argv[i], "--check-api"))
     {
       setEnvironment("OCLGRIND_CHECK_API", "1");
@@ -235,6 +256,10 @@ static bool parseArguments(int argc, char* argv[])
     {
       setEnvironment("OCLGRIND_DISABLE_PCH", "1");
     }
+    else if (!strcmp(argv[i], "--divergence"))
+    {
+      setEnvironment("OCLGRIND_DIVERGENCE", "1");
+    }
     else if (!strcmp(argv[i], "--dump-spir"))
     {
       setEnvironment("OCLGRIND_DUMP_SPIR", "1");
@@ -261,6 +286,15 @@ static bool parseArguments(int argc, char* argv[])
     {
       setEnvironment("OCLGRIND_INTERACTIVE", "1");
     }
+    else if (!strcmp(argv[i], "--local-mem-banks"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --local-mem-banks" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_LOCAL_MEM_BANKS", argv[i]);
+    }
     else if (!strcmp(argv[i], "--local-mem-size"))
     {
       if (++i >= argc)
@@ -270,6 +304,10 @@ static bool parseArguments(int argc, char* argv[])
       }
       setEnvironment("OCLGRIND_LOCAL_MEM_SIZE", argv[i]);
     }
+    else if (!strcmp(argv[i], "--lockstep"))
+    {
+      setEnvironment("OCLGRIND_LOCKSTEP", "1");
+    }
     else if (!strcmp(argv[i], "--log"))
     {
       if (++i >= argc)
@@ -324,10 +362,95 @@ static bool parseArguments(int argc, char* argv[])
       }
       setEnvironment("OCLGRIND_PLUGINS", argv[i]);
     }
+    else if (!strcmp(argv[i], "--profile"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --profile" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_PROFILE", argv[i]);
+    }
+    else if (!strcmp(argv[i], "--profile-format"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --profile-format" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_PROFILE_FORMAT", argv[i]);
+    }
     else if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quick"))
     {
       setEnvironment("OCLGRIND_QUICK", "1");
     }
+    else if (!strcmp(argv[i], "--sample"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --sample" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_SAMPLE", argv[i]);
+    }
+    else if (!strcmp(argv[i], "--sample-mode"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --sample-mode" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_SAMPLE_MODE", argv[i]);
+    }
+    else if (!strcmp(argv[i], "--sample-seed"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --sample-seed" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_SAMPLE_SEED", argv[i]);
+    }
+    else if (!strcmp(argv[i], "--self-profile"))
+    {
+      setEnvironment("OCLGRIND_SELF_PROFILE", "1");
+    }
+    else if (!strcmp(argv[i], "--simd-width"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --simd-width" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_SIMD_WIDTH", argv[i]);
+    }
+    else if (!strcmp(argv[i], "--stats"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --stats" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_STATS", argv[i]);
+    }
+    else if (!strcmp(argv[i], "--stats-format"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --stats-format" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_STATS_FORMAT", argv[i]);
+    }
+    else if (!strcmp(argv[i], "--trace"))
+    {
+      if (++i >= argc)
+      {
+        cerr << "Missing argument to --trace" << endl;
+        return false;
+      }
+      setEnvironment("OCLGRIND_TRACE", argv[i]);
+    }
     else if (!strcmp(argv[i], "--uniform-writes"))
     {
       setEnvironment("OCLGRIND_UNIFORM_WRITES", "1");
@@ -459,9 +582,21 @@ static void printUsage()
        << "       oclgrind [--help | --version]" << endl
        << endl
        << "Options:" << endl
+       << "  --array-checks               "
+          "Report the static array indices checked by MemCheck"
+       << endl
+       << "  --bank-conflicts             "
+          "Report local memory bank conflicts"
+       << endl
        << "  --build-options     OPTIONS  "
           "Additional options to pass to the OpenCL compiler"
        << endl
+       << "  --cache-line-size   BYTES    "
+          "Change the cache line size used by --cache-sim"
+       << endl
+       << "  --cache-sim                  "
+          "Simulate global memory coalescing and caches"
+       << endl
        << "  --check-api                  "
           "Report errors on API calls"
        << endl
@@ -477,6 +612,9 @@ static void printUsage()
        << "  --disable-pch                "
           "Don't use precompiled headers"
        << endl
+       << "  --divergence                 "
+          "Report branch divergence and SIMD efficiency"
+       << endl
        << "  --dump-spir                  "
           "Dump SPIR to /tmp/oclgrind_*.{ll,bc}"
        << endl
@@ -492,9 +630,15 @@ static void printUsage()
        << "  --interactive [-i]           "
           "Enable interactive mode"
        << endl
+       << "  --local-mem-banks   NUM      "
+          "Change the number of banks used by --bank-conflicts"
+       << endl
        << "  --local-mem-size    BYTES    "
           "Change the local memory size of the device"
        << endl
+       << "  --lockstep                   "
+          "Execute the work-items of each work-group in lock-step"
+       << endl
        << "  --log               LOGFILE  "
           "Redirect log/error messages to a file"
        << endl
@@ -513,9 +657,39 @@ static void printUsage()
        << "  --plugins           PLUGINS  "
           "Load colon separated list of plugin libraries"
        << endl
+       << "  --profile           FILE     "
+          "Write a source-line profile of the kernels to FILE"
+       << endl
+       << "  --profile-format    FORMAT   "
+          "Select the profile format (callgrind|json)"
+       << endl
        << "  --quick [-q]                 "
           "Only run first and last work-group"
        << endl
+       << "  --sample            NUM[%]   "
+          "Only run a sample of NUM (or NUM%) work-groups"
+       << endl
+       << "  --sample-mode       MODE     "
+          "Select sampled work-groups (strided|random|boundary)"
+       << endl
+       << "  --sample-seed       SEED     "
+          "Set the random seed used for work-group sampling"
+       << endl
+       << "  --self-profile               "
+          "Report where the simulator spends host time at exit"
+       << endl
+       << "  --simd-width        NUM      "
+          "Change the SIMD width used for performance analysis"
+       << endl
+       << "  --stats             FILE     "
+          "Write per-kernel statistics to FILE"
+       << endl
+       << "  --stats-format      FORMAT   "
+          "Select the statistics format (csv|json)"
+       << endl
+       << "  --trace             FILE     "
+          "Write a Chrome trace of commands and work-groups to FILE"
+       << endl
        << "  --uniform-writes             "
           "Don't suppress uniform write-write data-races"
        << endl
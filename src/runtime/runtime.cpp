@@ -23,6 +23,7 @@
 #include "core/Memory.h"
 #include "core/Program.h"
 #include "core/Queue.h"
+#include "core/TraceWriter.h"
 
 using namespace std;
 
@@ -187,11 +188,20 @@ public:
   APICallEntry(const char* name)
   {
     g_apiCallStack.push_back(name);
+    m_start = oclgrind::TraceWriter::isEnabled() ? oclgrind::now() : 0;
   }
   ~APICallEntry()
   {
+    if (m_start)
+    {
+      oclgrind::TraceWriter::addAPICall(g_apiCallStack.back(), m_start,
+                                        oclgrind::now());
+    }
     g_apiCallStack.pop_back();
   }
+
+private:
+  double m_start;
 };
 
 #define REGISTER_API APICallEntry apiCallEntry(__func__)
@@ -0,0 +1,14 @@
+kernel void bank_stride(global int *output)
+{
+  local int scratch[72];
+  int i = get_local_id(0);
+
+  // Consecutive words are in different banks
+  scratch[i] = i;
+
+  // Words that are a row of banks apart are all in the same bank
+  scratch[i * 8 + 8] = i;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+  output[i] = scratch[i] + scratch[i * 8 + 8];
+}
@@ -0,0 +1,13 @@
+kernel void coalescing(global const int *a, global const int *b,
+                       global int *output)
+{
+  int i = get_global_id(0);
+
+  // Consecutive work-items load from the same cache line
+  int x = a[i];
+
+  // Each work-item loads from a different cache line
+  int y = b[i * 16];
+
+  output[i] = x + y;
+}
@@ -0,0 +1,11 @@
+kernel void divergence_inst_counts(global int *output)
+{
+  int i = get_global_id(0);
+
+  // Odd and even work-items in each lane group take different paths, while
+  // the instruction counter observes every instruction
+  if (i % 2)
+  {
+    output[i] = 1;
+  }
+}
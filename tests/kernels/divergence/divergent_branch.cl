@@ -0,0 +1,10 @@
+kernel void divergent_branch(global int *output)
+{
+  int i = get_global_id(0);
+
+  // Odd and even work-items in each lane group take different paths
+  if (i % 2)
+  {
+    output[i] = 1;
+  }
+}
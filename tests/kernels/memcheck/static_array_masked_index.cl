@@ -0,0 +1,12 @@
+struct S
+{
+  int a;
+  char b[2];
+};
+
+kernel void static_array_masked_index(global char *output)
+{
+  volatile struct S s = {-1, {42, 7}};
+  int i = get_global_id(0);
+  output[i] = s.b[i & 1] + s.b[i];
+}
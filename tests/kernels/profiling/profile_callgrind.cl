@@ -0,0 +1,4 @@
+kernel void profile_callgrind()
+{
+  barrier(CLK_LOCAL_MEM_FENCE);
+}
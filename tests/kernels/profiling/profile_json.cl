@@ -0,0 +1,4 @@
+kernel void profile_json()
+{
+  barrier(CLK_LOCAL_MEM_FENCE);
+}
@@ -0,0 +1,4 @@
+kernel void stats_csv()
+{
+  barrier(CLK_LOCAL_MEM_FENCE);
+}
@@ -0,0 +1,7 @@
+kernel void sample(global int *output)
+{
+  size_t i = get_global_id(0) +
+             (get_global_id(1) + get_global_id(2) * get_global_size(1)) *
+               get_global_size(0);
+  output[i] = 1;
+}
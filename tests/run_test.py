@@ -88,10 +88,22 @@ def run(output_suffix):
     if first_line[:7] == '# ARGS:':
         cmd.extend(first_line[8:].split(' '))
 
+    # Files written by the test are checked after its output
+    output_files = []
+    for line in open(test_file):
+      if line[:9] == '# OUTPUT:':
+        output_files.append(line[10:].strip())
+
     cmd.append(test_file)
 
     retval = subprocess.call(cmd, stdout=out, stderr=out, stdin=inp)
 
+    out.seek(0, os.SEEK_END)
+    for output_file in output_files:
+      if os.path.isfile(output_file):
+        out.write(open(output_file).read())
+        os.remove(output_file)
+
     os.chdir(current_dir)
   else:
     retval = subprocess.call([oclgrind_exe,test_full_path],
@@ -163,14 +175,20 @@ def run(output_suffix):
           fail()
       oi += 1
 
+# Keep output of lock-step runs separate from the default mode
+if os.environ.get("OCLGRIND_LOCKSTEP") == "1":
+  mode_suffix = '_lockstep'
+else:
+  mode_suffix = ''
+
 print('Running test with optimisations')
-run('')
+run(mode_suffix)
 print('PASSED')
 
 print('')
 print('Running test without optimisations')
 os.environ["OCLGRIND_BUILD_OPTIONS"] = "-cl-opt-disable"
-run('_noopt')
+run(mode_suffix + '_noopt')
 print('PASSED')
 
 # Test passed